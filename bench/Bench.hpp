@@ -0,0 +1,80 @@
+/*	Copyright (c) 2023 Mauro Grassia
+**	
+**	Permission is granted to use, modify and redistribute this software.
+**	Modified versions of this software MUST be marked as such.
+**	
+**	This software is provided "AS IS". In no event shall
+**	the authors or copyright holders be liable for any claim,
+**	damages or other liability. The above copyright notice
+**	and this permission notice shall be included in all copies
+**	or substantial portions of the software.
+**	
+*/
+
+#ifndef LUAPP_BENCH_HPP
+#define LUAPP_BENCH_HPP
+
+#include "LuaPP.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+/*	Every benchmark is an executable that prints one line per case: the
+ *	best of a few runs, as time per operation. Scripts are compiled once
+ *	and only their execution is timed.
+ */
+
+namespace Bench {
+
+constexpr int Repeats = 5;
+
+// The fastest of Repeats runs of body(), in seconds.
+template <typename F>
+double Fastest(F&& body) {
+	double best = 0;
+	for(int i = 0; i < Repeats; ++i) {
+		auto const start = std::chrono::steady_clock::now();
+		body();
+		std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+		if(i == 0 || elapsed.count() < best)
+			best = elapsed.count();
+	}
+	return best;
+}
+
+// A new State with the standard libraries and the LuaPP metatables.
+inline std::shared_ptr<Lua::State> NewState() {
+	std::shared_ptr<Lua::State> state = Lua::StateManager::Get().Create();
+	state->openlibs();
+	state->luapp_register_metatables();
+	return state;
+}
+
+// The fastest run of a chunk, in seconds. Exits on a Lua error.
+inline double RunLua(Lua::State& state, char const* code) {
+	if(state.loadstring(code) != LUA_OK) {
+		std::fprintf(stderr, "%s\n", state.tostdstring(-1).c_str());
+		std::exit(1);
+	}
+	int const chunk = state.gettop();
+	double const seconds = Fastest([&state, chunk] {
+		state.pushvalue(chunk);
+		if(state.pcall(0, 0, 0) != LUA_OK) {
+			std::fprintf(stderr, "%s\n", state.tostdstring(-1).c_str());
+			std::exit(1);
+		}
+	});
+	state.settop(chunk - 1);
+	return seconds;
+}
+
+inline void Report(char const* name, double seconds, std::size_t operations) {
+	std::printf("%-52s %9.1f ns/op\n", name, seconds * 1e9 / static_cast<double>(operations));
+}
+
+}
+
+#endif
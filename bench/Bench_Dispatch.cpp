@@ -0,0 +1,63 @@
+#include "Bench.hpp"
+#include "StateManager.hpp"
+
+#include <functional>
+#include <new>
+#include <string>
+
+// Throughput of calls from Lua into empty C++ functions. "before" is the
+// Functor::Call of the original code: a StateManager map lookup, a weak_ptr
+// lock and a luaL_checkudata by name on every call.
+
+static constexpr std::size_t Calls = 5000000;
+
+typedef std::function<int(Lua::State&)> functor_type;
+
+static int EmptyC(lua_State*) {
+	return 0;
+}
+static int LegacyCall(lua_State* s) {
+	std::shared_ptr<Lua::State> state = Lua::StateManager::Get().Find(s);
+	if(!state)
+		return 0;
+	functor_type* p = static_cast<functor_type*>(luaL_checkudata(s, 1, "bench_legacy_functor"));
+	return (*p)(*state);
+}
+static void PushLegacyFunctor(lua_State* s, functor_type function) {
+	new(lua_newuserdatauv(s, sizeof(functor_type), 0)) functor_type(std::move(function));
+	if(luaL_newmetatable(s, "bench_legacy_functor")) {
+		lua_pushcfunction(s, &LegacyCall);
+		lua_setfield(s, -2, "__call");
+	}
+	lua_setmetatable(s, -2);
+}
+static void Empty() {}
+
+static void Measure(Lua::State& state, char const* name, char const* function) {
+	std::string const code = std::string("local f = ") + function + " for i = 1, " + std::to_string(Calls) + " do f() end";
+	Bench::Report(name, Bench::RunLua(state, code.c_str()), Calls);
+
+	std::string const coroutine = "coroutine.wrap(function() " + code + " end)()";
+	Bench::Report((std::string(name) + ", in a coroutine").c_str(), Bench::RunLua(state, coroutine.c_str()), Calls);
+}
+
+int main() {
+	auto state = Bench::NewState();
+	// More States make the map lookup deeper, as in an application.
+	std::shared_ptr<Lua::State> others[15];
+	for(auto& other : others)
+		other = Lua::StateManager::Get().Create();
+
+	state->luapp_add_translated_function("empty_c", &EmptyC);
+	functor_type const empty = [](Lua::State&) -> int { return 0; };
+	PushLegacyFunctor(state->GetState(), empty);
+	state->setglobal("empty_legacy");
+	state->luapp_add_translated_function("empty_functor", empty);
+	state->luapp_add_translated_function("empty_transform", Lua::Transform<&Empty>());
+
+	Measure(*state, "lua_CFunction", "empty_c");
+	Measure(*state, "Functor, StateManager lookup (before)", "empty_legacy");
+	Measure(*state, "Functor, extra space (after)", "empty_functor");
+	Measure(*state, "Transform<&f>()", "empty_transform");
+	return 0;
+}
@@ -0,0 +1,68 @@
+#include "Bench.hpp"
+
+#include <cstdio>
+#include <string>
+
+// Bound objects created and dropped in a loop, stored inline in their
+// userdata or in the pool of the State, the memory left in the pool after
+// the loop, and the Lua heap the objects take while alive.
+
+static constexpr std::size_t Objects = 1000000;
+static constexpr std::size_t Live    = 100000;
+
+struct Particle {
+	double state[16] = {};
+};
+struct PooledParticle {
+	double state[16] = {};
+};
+
+template <>
+struct MetatableDescriptor<Particle> {
+	static char const* name() { return "bench_particle_mt"; }
+	static char const* luaname() { return "Particle"; }
+	static char const* constructor() { return "new"; }
+	static bool construct(Particle* p) { return Lua::DefaultConstructor(p); }
+};
+template <>
+struct MetatableDescriptor<PooledParticle> {
+	static constexpr bool pooled = true;
+	static char const* name() { return "bench_pooled_particle_mt"; }
+	static char const* luaname() { return "PooledParticle"; }
+	static char const* constructor() { return "new"; }
+	static bool construct(PooledParticle* p) { return Lua::DefaultConstructor(p); }
+};
+
+static void Run(Lua::State& state, std::string const& code) {
+	if(state.loadstring(code.c_str()) != LUA_OK || state.pcall(0, 0, 0) != LUA_OK) {
+		std::fprintf(stderr, "%s\n", state.tostdstring(-1).c_str());
+		std::exit(1);
+	}
+}
+
+template <typename T>
+static void Measure(Lua::State& state, char const* type) {
+	std::string const churn = std::string("local new = ") + type + ".new for i = 1, " + std::to_string(Objects) + " do new() end";
+	Bench::Report((std::string(type) + ".new, dropped").c_str(), Bench::RunLua(state, churn.c_str()), Objects);
+	Lua::PoolStatistics const pool = Lua::GetPoolStatistics<T>(state);
+	std::printf("%-52s %9zu KB, %zu objects not yet collected\n", (std::string(type) + " pool").c_str(), pool.slabs * Lua::impl::ObjectPool<T>::SlabSize / 1024, pool.live);
+
+	Run(state, "live = {}");
+	state.gc(Lua::GC_COLLECT, 0);
+	int const before = state.gc(Lua::GC_COUNT, 0);
+	Run(state, std::string("local new = ") + type + ".new for i = 1, " + std::to_string(Live) + " do live[i] = new() end");
+	int const after = state.gc(Lua::GC_COUNT, 0);
+	std::printf("%-52s %9d KB for %zu userdata\n", (std::string(type) + " Lua heap").c_str(), after - before, Live);
+	Run(state, "live = nil");
+	state.gc(Lua::GC_COLLECT, 0);
+}
+
+int main() {
+	auto state = Bench::NewState();
+	state->luapp_register_object<Particle>();
+	state->luapp_register_object<PooledParticle>();
+
+	Measure<Particle>(*state, "Particle");
+	Measure<PooledParticle>(*state, "PooledParticle");
+	return 0;
+}
@@ -0,0 +1,127 @@
+#include "Bench.hpp"
+
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Resident memory is only measured on Linux, where /proc gives it.
+#if defined(__linux__)
+#	include <fstream>
+#	include <sys/wait.h>
+#	include <unistd.h>
+#endif
+
+// Startup of a State that binds many types, registered eagerly or lazily:
+// the time to create it, the Lua heap and, on Linux, the resident memory
+// it takes, and the cost of the first use of a lazily registered type.
+
+static constexpr std::size_t Types  = 200;
+static constexpr std::size_t States = 100;
+
+template <std::size_t N>
+struct Bound {
+	int value = 0;
+	int get() const { return value; }
+	void set(int v) { value = v; }
+	int twice() const { return value * 2; }
+	bool positive() const { return value > 0; }
+};
+
+template <std::size_t N>
+struct MetatableDescriptor<Bound<N>> {
+	static char const* name() {
+		static std::string const name = "bench_bound_mt_" + std::to_string(N);
+		return name.c_str();
+	}
+	static char const* luaname() {
+		static std::string const name = "Bound" + std::to_string(N);
+		return name.c_str();
+	}
+	static char const* constructor() { return "new"; }
+	static bool construct(Bound<N>* p) { return Lua::DefaultConstructor(p); }
+	static void metatable(Lua::member_function_storage<Bound<N>>& mt) {
+		mt["get"]      = Lua::Bind<&Bound<N>::get>();
+		mt["set"]      = Lua::Bind<&Bound<N>::set>();
+		mt["twice"]    = Lua::Bind<&Bound<N>::twice>();
+		mt["positive"] = Lua::Bind<&Bound<N>::positive>();
+	}
+};
+
+template <std::size_t... N>
+static void RegisterAll(Lua::State& state, bool lazy, std::index_sequence<N...>) {
+	if(lazy)
+		(state.luapp_register_object_lazy<Bound<N>>(), ...);
+	else
+		(state.luapp_register_object<Bound<N>>(), ...);
+}
+
+static std::shared_ptr<Lua::State> NewState(bool lazy) {
+	std::shared_ptr<Lua::State> state = Bench::NewState();
+	RegisterAll(*state, lazy, std::make_index_sequence<Types>());
+	return state;
+}
+
+#if defined(__linux__)
+// Resident memory of the process, in KB.
+static long ResidentKB() {
+	long pages = 0, resident = 0;
+	std::ifstream("/proc/self/statm") >> pages >> resident;
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+#endif
+
+static void Measure(char const* name, bool lazy) {
+	// Every type is bound once before timing, so that only the
+	// per-State work is measured.
+	NewState(lazy);
+
+	double const seconds = Bench::Fastest([lazy] { NewState(lazy); });
+	Bench::Report((std::string(name) + ": new State").c_str(), seconds, 1);
+
+	std::shared_ptr<Lua::State> state = NewState(lazy);
+	state->gc(Lua::GC_COLLECT, 0);
+	std::printf("%-52s %9d KB\n", (std::string(name) + ": Lua heap").c_str(), state->gc(Lua::GC_COUNT, 0));
+
+#if defined(__linux__)
+	long const before = ResidentKB();
+	std::vector<std::shared_ptr<Lua::State>> states;
+	for(std::size_t i = 0; i < States; ++i)
+		states.push_back(NewState(lazy));
+	std::printf("%-52s %9ld KB\n", (std::string(name) + ": resident memory per State").c_str(), (ResidentKB() - before) / static_cast<long>(States));
+	states.clear();
+#endif
+
+	std::string const use = "local o = Bound" + std::to_string(Types / 2) + ".new() o:set(1) assert(o:twice() == 2)";
+	double const first = Bench::Fastest([lazy, &use] {
+		std::shared_ptr<Lua::State> fresh = NewState(lazy);
+		fresh->loadstring(use.c_str());
+		fresh->pcall(0, 0, 0);
+	});
+	Bench::Report((std::string(name) + ": new State and first use of a type").c_str(), first, 1);
+}
+
+int main() {
+	std::shared_ptr<Lua::State> state = Bench::NewState();
+	state->gc(Lua::GC_COLLECT, 0);
+	std::printf("%-52s %9d KB\n", "No types: Lua heap", state->gc(Lua::GC_COUNT, 0));
+	state.reset();
+	std::fflush(stdout);
+
+	for(bool const lazy : { false, true }) {
+#if defined(__linux__)
+		// Each mode runs in its own process, so that its resident memory
+		// is not served from what the other one gave back.
+		pid_t const child = fork();
+		if(child == 0) {
+			Measure(lazy ? "Lazy" : "Eager", lazy);
+			std::fflush(stdout);
+			_exit(0);
+		}
+		waitpid(child, nullptr, 0);
+#else
+		Measure(lazy ? "Lazy" : "Eager", lazy);
+#endif
+	}
+	return 0;
+}
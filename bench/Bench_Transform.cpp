@@ -0,0 +1,64 @@
+#include "Bench.hpp"
+
+#include <string>
+#include <tuple>
+
+// Calls into a bound add(int, int), with good and with bad arguments. The
+// "before" case marshals the arguments like the original Transform: each
+// reader throws a lua_exception with a formatted message, and the wrapper
+// turns it into a Lua error.
+
+static constexpr std::size_t Calls = 2000000;
+
+static int add(int a, int b) {
+	return a + b;
+}
+
+template <typename T>
+static void LegacyRead(Lua::State& state, int index, T& destination) {
+	std::optional<T> value = Lua::TypeConverter<T>::Read(state, index);
+	if(!value)
+		throw Lua::lua_exception(
+			std::string("Error: Function argument #") + std::to_string(index) + " should be of type " + Lua::TypeConverter<T>::Name() + ", got "
+			+ state.typename_aux(index) + " instead."
+		);
+	destination = *value;
+}
+static int LegacyAdd(lua_State* s) {
+	int const results = Lua::State::WithState(s, [](Lua::State& state) -> int {
+		try {
+			std::tuple<int, int> arguments;
+			LegacyRead(state, 1, std::get<0>(arguments));
+			LegacyRead(state, 2, std::get<1>(arguments));
+			if(state.gettop() > 2)
+				throw Lua::lua_exception(std::string("Too many arguments provided. Read: 2, Given: ") + std::to_string(state.gettop()));
+			return static_cast<int>(Lua::TypeConverter<int>::Push(state, std::apply(add, arguments)));
+		}
+		catch(std::exception& e) {
+			state.pushfstring("C++ Exception Thrown.\n%s", e.what());
+			return -1;
+		}
+	});
+	return results < 0 ? lua_error(s) : results;
+}
+
+static void Measure(Lua::State& state, char const* name, char const* function) {
+	std::string const calls = std::to_string(Calls);
+	std::string const success = std::string("local f = ") + function + " for i = 1, " + calls + " do f(i, 2) end";
+	Bench::Report((std::string(name) + ", success").c_str(), Bench::RunLua(state, success.c_str()), Calls);
+
+	std::string const failure = std::string("local f = ") + function + " for i = 1, " + calls + " do pcall(f, i, 'x') end";
+	Bench::Report((std::string(name) + ", bad argument").c_str(), Bench::RunLua(state, failure.c_str()), Calls);
+}
+
+int main() {
+	auto state = Bench::NewState();
+	state->luapp_add_translated_function("add_legacy", &LegacyAdd);
+	state->luapp_add_translated_function("add_transform", Lua::Transform<&add>());
+
+	Measure(*state, "Throwing readers (before)", "add_legacy");
+	Measure(*state, "Status readers (after)", "add_transform");
+	// The cost of pcall and of a plain Lua error, for reference.
+	Measure(*state, "Lua function", "function(a, b) if type(b) ~= 'number' then error('bad') end return a + b end");
+	return 0;
+}
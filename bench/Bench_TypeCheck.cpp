@@ -0,0 +1,39 @@
+#include "Bench.hpp"
+
+#include <string>
+
+// Calls that check the type of a bound userdata argument: a method call on
+// the object and a free function taking a pointer to it.
+
+static constexpr std::size_t Calls = 5000000;
+
+struct Counter {
+	int value = 0;
+	int get() const { return value; }
+};
+
+template <>
+struct MetatableDescriptor<Counter> {
+	static char const* name() { return "bench_counter_mt"; }
+	static char const* luaname() { return "Counter"; }
+	static char const* constructor() { return "new"; }
+	static bool construct(Counter* p) { return Lua::DefaultConstructor(p); }
+	static void metatable(Lua::member_function_storage<Counter>& mt) { mt["get"] = Lua::Bind<&Counter::get>(); }
+};
+
+static int valueOf(Counter* counter) {
+	return counter->value;
+}
+
+int main() {
+	auto state = Bench::NewState();
+	state->luapp_register_object<Counter>();
+	state->luapp_add_translated_function("valueOf", Lua::Transform<&valueOf>());
+
+	std::string const calls = std::to_string(Calls);
+	std::string const method = "local c = Counter.new() for i = 1, " + calls + " do c:get() end";
+	Bench::Report("Method call", Bench::RunLua(*state, method.c_str()), Calls);
+	std::string const function = "local c, f = Counter.new(), valueOf for i = 1, " + calls + " do f(c) end";
+	Bench::Report("Function taking Counter*", Bench::RunLua(*state, function.c_str()), Calls);
+	return 0;
+}
@@ -0,0 +1,290 @@
+/*	Copyright (c) 2023 Mauro Grassia
+**	
+**	Permission is granted to use, modify and redistribute this software.
+**	Modified versions of this software MUST be marked as such.
+**	
+**	This software is provided "AS IS". In no event shall
+**	the authors or copyright holders be liable for any claim,
+**	damages or other liability. The above copyright notice
+**	and this permission notice shall be included in all copies
+**	or substantial portions of the software.
+**	
+*/
+
+#ifndef LUAPP_FUNCTION_HPP
+#define LUAPP_FUNCTION_HPP
+
+#include "LuaInclude.hpp"
+#include "Reference.hpp"
+#include "TypeConverter.hpp"
+#include "Transform.hpp"
+#include "Overload.hpp"
+
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+/*	A Lua function held in the registry and callable from C++:
+ *
+ *		Lua::LuaFunction<int(int, std::string)> onEvent(s.luapp_read_reference(1));
+ *		int handled = onEvent(42, "hello");
+ *
+ *	std::tuple results are read from as many Lua return values.
+ *	LuaFunction and std::function can also be used as arguments of
+ *	translated functions.
+ */
+
+namespace Lua {
+namespace impl {
+template <typename T>
+struct ResultCount {
+	static constexpr int value = ValueCount<T>::value;
+};
+template <>
+struct ResultCount<void> {
+	static constexpr int value = 0;
+};
+
+template <typename T>
+struct ResultReader {
+	static T Read(Lua::State& state, int luaIndex) {
+		typename std::decay<T>::type result {};
+		InvokeStatus status;
+		if(!LuaArgumentReader<typename std::decay<T>::type>::Read(state, luaIndex, result, status))
+			throw lua_exception(
+				std::string("Lua::LuaFunction: The result should be of type ") + status.expected + ", got " + state.typename_aux(status.index) + " instead."
+			);
+		return result;
+	}
+};
+template <typename... T>
+struct ResultReader<std::tuple<T...>> {
+	static std::tuple<T...> Read(Lua::State& state, int luaIndex) {
+		std::tuple<typename std::decay<T>::type...> results;
+		InvokeStatus status;
+		if(!TupleArgumentReader<sizeof...(T), std::tuple<typename std::decay<T>::type...>>::Read(state, luaIndex, results, status))
+			throw lua_exception(
+				std::string("Lua::LuaFunction: Result #") + std::to_string(status.index - luaIndex + 1) + " should be of type " + status.expected + ", got "
+				+ state.typename_aux(status.index) + " instead."
+			);
+		return results;
+	}
+};
+}
+
+template <typename T>
+class LuaFunction;
+
+template <typename TRetVal, typename... TArgs>
+class LuaFunction<TRetVal(TArgs...)> {
+	ReferenceType m_function;
+
+public:
+	LuaFunction() {}
+	explicit LuaFunction(ReferenceType function)
+		: m_function(std::move(function)) {}
+
+	explicit operator bool() const noexcept { return m_function && *m_function; }
+	ReferenceType const& reference() const noexcept { return m_function; }
+
+	// Calls the function on the State it was read from.
+	TRetVal operator()(TArgs... args) const {
+		std::shared_ptr<Lua::State> state = m_function ? m_function->state().lock() : std::shared_ptr<Lua::State>();
+		if(!state)
+			throw lua_exception("Lua::LuaFunction: The function is empty or its State has been closed.");
+		return call(*state, std::forward<TArgs>(args)...);
+	}
+
+	// Calls the function on the given State, which may be a coroutine of its owner.
+	TRetVal call(Lua::State& state, TArgs... args) const {
+		if(!*this)
+			throw lua_exception("Lua::LuaFunction: The function is empty or its State has been closed.");
+		if(!state.luapp_owns_reference(*m_function))
+			throw lua_exception("Lua::LuaFunction: The function belongs to another State.");
+
+		constexpr int results   = impl::ResultCount<TRetVal>::value;
+		constexpr int arguments = (0 + ... + impl::ValueCount<typename std::decay<TArgs>::type>::value);
+
+		// Room for the function, its arguments and its results, reserved once.
+		if(!state.checkstack(1 + arguments + results))
+			throw lua_exception("Lua::LuaFunction: Stack overflow.");
+
+		int const top = state.gettop();
+		state.rawgeti(m_function->table(), m_function->key());
+		(TypeConverter<typename std::decay<TArgs>::type>::Push(state, std::forward<TArgs>(args)), ...);
+
+		if(state.pcall(state.gettop() - top - 1, results) != LUA_OK) {
+			std::string error = state.tostdstring(-1);
+			state.settop(top);
+			throw lua_exception(std::string("Lua::LuaFunction: ") + error);
+		}
+
+		if constexpr(std::is_void<TRetVal>::value) {
+			state.settop(top);
+		}
+		else {
+			try {
+				TRetVal rv = impl::ResultReader<TRetVal>::Read(state, top + 1);
+				state.settop(top);
+				return rv;
+			}
+			catch(...) {
+				state.settop(top);
+				throw;
+			}
+		}
+	}
+};
+
+template <typename TRetVal, typename... TArgs>
+struct TypeConverter<LuaFunction<TRetVal(TArgs...)>> {
+	typedef std::optional<LuaFunction<TRetVal(TArgs...)>> Arg;
+	static Arg Read(Lua::State& s, int id) {
+		if(!s.isfunction(id))
+			return std::nullopt;
+		return LuaFunction<TRetVal(TArgs...)>(s.luapp_read_reference(id));
+	}
+	static std::size_t Push(Lua::State& s, LuaFunction<TRetVal(TArgs...)> const& v) {
+		s.luapp_push_reference(v.reference());
+		return 1;
+	}
+	static std::string Name() { return "function"; }
+	static char const* TypeName() { return "function"; }
+};
+
+// Lua functions read as std::function call back into Lua;
+// std::function values are pushed as translated functions.
+template <typename TRetVal, typename... TArgs>
+struct TypeConverter<std::function<TRetVal(TArgs...)>> {
+	typedef std::optional<std::function<TRetVal(TArgs...)>> Arg;
+	static Arg Read(Lua::State& s, int id) {
+		if(!s.isfunction(id))
+			return std::nullopt;
+		return std::function<TRetVal(TArgs...)>(LuaFunction<TRetVal(TArgs...)>(s.luapp_read_reference(id)));
+	}
+	static std::size_t Push(Lua::State& s, std::function<TRetVal(TArgs...)> const& v) {
+		if(!v) {
+			s.pushnil();
+			return 1;
+		}
+		return static_cast<std::size_t>(s.luapp_push_translated_function(Lua::Transform(v)));
+	}
+	static std::string Name() { return "function"; }
+	static char const* TypeName() { return "function"; }
+};
+
+namespace impl {
+template <typename T>
+struct BatchArguments {
+	static constexpr int count = ValueCount<T>::value;
+	static void Push(Lua::State& state, T const& value) { TypeConverter<T>::Push(state, value); }
+};
+template <typename... T>
+struct BatchArguments<std::tuple<T...>> {
+	static constexpr int count = (0 + ... + ValueCount<typename std::decay<T>::type>::value);
+	static void Push(Lua::State& state, std::tuple<T...> const& values) {
+		std::apply([&state](T const&... value) { (TypeConverter<typename std::decay<T>::type>::Push(state, value), ...); }, values);
+	}
+};
+
+// Adds a traceback to errors raised by batched calls.
+inline int BatchMessageHandler(lua_State* s) {
+	char const* message = lua_tostring(s, 1);
+	if(!message)
+		message = lua_pushfstring(s, "(error object is a %s value)", luaL_typename(s, 1));
+	luaL_traceback(s, s, message, 1);
+	return 1;
+}
+
+template <typename TResult, typename TPushArguments, typename TOutputIt>
+TOutputIt CallBatch(Lua::State& state, ReferenceType const& function, std::size_t count, int arguments, TPushArguments const& pushArguments, TOutputIt out) {
+	if(!function || !*function)
+		throw lua_exception("Lua::State::luapp_call_batch: The function is empty or its State has been closed.");
+	if(!state.luapp_owns_reference(*function))
+		throw lua_exception("Lua::State::luapp_call_batch: The function belongs to another State.");
+	state.luapp_drain_releases();
+
+	constexpr int results = ResultCount<TResult>::value;
+
+	// Error handler, function, one copy of it, its arguments and its results.
+	if(!state.checkstack(3 + arguments + results))
+		throw lua_exception("Lua::State::luapp_call_batch: Stack overflow.");
+
+	int const top = state.gettop();
+	state.pushcfunction(&BatchMessageHandler);
+	state.rawgeti(function->table(), function->key());
+	int const handler = top + 1;
+	int const base    = top + 2;
+
+	for(std::size_t i = 0; i < count; ++i) {
+		state.pushvalue(base);
+		pushArguments(i);
+
+		if(state.pcall(state.gettop() - base - 1, results, handler) != LUA_OK) {
+			std::string error = state.tostdstring(-1);
+			state.settop(top);
+			throw lua_exception(std::string("Lua::State::luapp_call_batch: Call #") + std::to_string(i + 1) + " failed.\n" + error);
+		}
+
+		if constexpr(results > 0) {
+			try {
+				*out = ResultReader<TResult>::Read(state, base + 1);
+				++out;
+			}
+			catch(...) {
+				state.settop(top);
+				throw;
+			}
+		}
+		state.settop(base);
+	}
+
+	state.settop(top);
+	return out;
+}
+}
+
+template <typename TResult, typename TInputIt, typename TOutputIt>
+TOutputIt State::luapp_call_batch(ReferenceType const& function, TInputIt first, TInputIt last, TOutputIt out) {
+	typedef impl::BatchArguments<typename std::decay<decltype(*first)>::type> arguments;
+
+	std::size_t const count = static_cast<std::size_t>(std::distance(first, last));
+	return impl::CallBatch<TResult>(
+		*this, function, count, arguments::count,
+		[this, &first](std::size_t) {
+			arguments::Push(*this, *first);
+			++first;
+		},
+		out
+	);
+}
+
+template <typename TResult, typename TOutputIt, typename... TColumns>
+TOutputIt State::luapp_call_batch_columns(ReferenceType const& function, std::size_t count, TOutputIt out, TColumns const&... columns) {
+	return impl::CallBatch<TResult>(
+		*this, function, count, static_cast<int>(sizeof...(TColumns)),
+		[this, &columns...](std::size_t i) {
+			(TypeConverter<typename std::decay<decltype(columns[i])>::type>::Push(*this, columns[i]), ...);
+		},
+		out
+	);
+}
+
+namespace impl {
+template <typename TRetVal, typename... TArgs>
+struct ArgumentMatcher<LuaFunction<TRetVal(TArgs...)>> {
+	static bool Match(Lua::State& s, int id) { return s.isfunction(id); }
+};
+template <typename TRetVal, typename... TArgs>
+struct ArgumentMatcher<std::function<TRetVal(TArgs...)>> {
+	static bool Match(Lua::State& s, int id) { return s.isfunction(id); }
+};
+}
+}
+
+#endif
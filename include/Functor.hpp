@@ -15,10 +15,21 @@
 #define LUAPP_FUNCTOR_HPP
 
 #include "FwdDecl.hpp"
+#include "Utils.hpp"
 #include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace Lua::impl {
 
+// Defined in State.hpp, once Lua::State is complete.
+template <typename F>
+int WithState(lua_State*, F&&);
+
+template <typename F>
+class TypedFunctor;
+
 class State;
 class Functor {
 	friend class State;
@@ -30,6 +41,80 @@ class Functor {
 public:
 	static void Register(lua_State*);
 	static int Push(lua_State*, functor_type);
+
+	// Stores the callable itself inside the userdata, moving it when possible.
+	template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, functor_type>::value>::type>
+	static int Push(lua_State* s, F&& function) {
+		return TypedFunctor<typename std::decay<F>::type>::Push(s, std::forward<F>(function));
+	}
+};
+
+// Userdata holding a callable of concrete type F.
+// Every F gets its own metatable, whose __call and __gc invoke F directly.
+template <typename F>
+class TypedFunctor {
+	static inline char const s_metatableKey = 0;
+
+	static F* FromStack(lua_State* s, int arg) {
+		// The metatable is the first upvalue of its own metamethods.
+		void* p = lua_touserdata(s, arg);
+		if(!p || !lua_getmetatable(s, arg))
+			return nullptr;
+		bool const isFunctor = lua_rawequal(s, -1, lua_upvalueindex(1));
+		lua_pop(s, 1);
+		return isFunctor ? static_cast<F*>(p) : nullptr;
+	}
+	static int Call(lua_State* s) {
+		F* p = FromStack(s, 1);
+		if(!p)
+			return luaL_argerror(s, 1, "luapp functor expected");
+
+		int const results = WithState(s, [p, s](Lua::State& state) -> int {
+			return CatchExceptions(s, [p, &state] { return (*p)(state); });
+		});
+		return results < 0 ? lua_error(s) : results;
+	}
+	static int Destroy(lua_State* s) {
+		F* p = FromStack(s, 1);
+		if(p) {
+			p->~F();
+			markAllocation(AT_UDATA, -1);
+		}
+		return 0;
+	}
+	static void PushMetatable(lua_State* s) {
+		if(lua_rawgetp(s, LUA_REGISTRYINDEX, &s_metatableKey) == LUA_TTABLE)
+			return;
+		lua_pop(s, 1);
+
+		lua_createtable(s, 0, 2);
+		lua_pushvalue(s, -1);
+		lua_pushcclosure(s, &TypedFunctor::Call, 1);
+		lua_setfield(s, -2, "__call");
+		if constexpr(!std::is_trivially_destructible<F>::value) {
+			lua_pushvalue(s, -1);
+			lua_pushcclosure(s, &TypedFunctor::Destroy, 1);
+			lua_setfield(s, -2, "__gc");
+		}
+		lua_pushvalue(s, -1);
+		lua_rawsetp(s, LUA_REGISTRYINDEX, &s_metatableKey);
+	}
+
+public:
+	template <typename G>
+	static int Push(lua_State* s, G&& function) {
+		F* p = static_cast<F*>(lua_newuserdatauv(s, sizeof(F), 0));
+		if(!p)
+			return 0;
+
+		new(p) F(std::forward<G>(function));
+		if constexpr(!std::is_trivially_destructible<F>::value)
+			markAllocation(AT_UDATA, +1);
+
+		PushMetatable(s);
+		lua_setmetatable(s, -2);
+		return 1;
+	}
 };
 
 }
@@ -15,10 +15,17 @@
 #define LUAPP_HPP
 
 #include "FwdDecl.hpp"
+#include "Function.hpp"
 #include "LuaInclude.hpp"
+#include "NumericArray.hpp"
+#include "Operators.hpp"
+#include "Overload.hpp"
 #include "State.hpp"
 #include "StateManager.hpp"
+#include "TableView.hpp"
 #include "Transform.hpp"
 #include "TypeConverter.hpp"
+#include "Value.hpp"
+#include "View.hpp"
 
 #endif
@@ -15,15 +15,23 @@
 #define LUAPP_METATABLEMANAGER_HPP
 
 #include <map>
+#include <memory>
+#include <new>
 #include <functional>
 #include <vector>
 #include <string>
 #include <utility>
 #include <exception>
+#include <type_traits>
+#include <cstring>
+#include <string_view>
+#include <tuple>
 
 #include "LuaInclude.hpp"
 #include "Utils.hpp"
 #include "Functor.hpp"
+#include "ObjectPool.hpp"
+#include "PropertyIndex.hpp"
 
 template <typename T>
 struct MetatableDescriptor;
@@ -33,13 +41,24 @@ struct MetatableDescriptor;
  *		static char const* luaname() { return "stdstring"; }
  *		static char const* constructor() { return "create"; }
  *      static bool construct(std::string* p) { return new (p) std::string(); return true; }
+ *		static constexpr bool direct_index = true; // Optional: __index is the methods table itself, unless there are properties
+ *		static constexpr bool pooled = true; // Optional: objects live in a per-State pool, see Lua::GetPoolStatistics
+ *		typedef std::tuple<Base> bases; // Optional: inherits the bindings of Base, and converts to Base*
+ *		// Optional: methods installed with a single luaL_setfuncs, with nothing built at runtime
+ *		static constexpr luaL_Reg methods[] = {
+ *			{ "length", Lua::Bind<&std::string::length>() },
+ *			{ nullptr, nullptr }
+ *		};
+ *		// Optional when methods is declared
  *		static void metatable(Lua::member_function_storage<std::string>& mt) {
  *			// Add metatable functions
  *			mt["size"] = Lua::Transform(&std::string::size);
- *			mt["display"] = Lua::Transform([](std::string* v) -> int {
- *				std::cout << *v;
- *				return 0;
- *			};
+ *			mt["empty"] = Lua::Bind<&std::string::empty>(); // Plain lua_CFunction
+ *			mt["display"] = Lua::Transform<&display>(); // Given static int display(std::string* v)
+ *			// Operators such as mt.arithmetic<Lua::OP_ADD>() are listed in Operators.hpp.
+ *			// Data members are exposed with mt.property("x", &Vector::x),
+ *			// or mt.property("id", &Entity::id, true) when read-only.
+ *			// Other keys may be handled with mt.fallback(index, newindex).
  *      }
  *	};
  */
@@ -49,13 +68,23 @@ namespace impl {
 template <typename T>
 class ClassMemberFunctor {
 	std::function<int(Lua::State&)> m_functor;
+	lua_CFunction m_cfunction;
 
 public:
-	ClassMemberFunctor() {}
+	ClassMemberFunctor()
+		: m_cfunction(nullptr) {}
 	ClassMemberFunctor(std::function<int(Lua::State&)> f)
-		: m_functor(std::move(f)) {}
-
-	std::function<int(Lua::State&)> functor() const { return m_functor; }
+		: m_functor(std::move(f)),
+		  m_cfunction(nullptr) {}
+	ClassMemberFunctor(lua_CFunction f)
+		: m_cfunction(f) {}
+	template <typename F, typename = typename std::enable_if<std::is_invocable_r<int, F&, Lua::State&>::value>::type>
+	ClassMemberFunctor(F f)
+		: m_functor(std::move(f)),
+		  m_cfunction(nullptr) {}
+
+	std::function<int(Lua::State&)> const& functor() const { return m_functor; }
+	lua_CFunction cfunction() const { return m_cfunction; }
 
 	int operator()(Lua::State& state) const {
 		if(m_functor)
@@ -64,29 +93,294 @@ public:
 	}
 };
 
+// A data member of T exposed as a field. The member pointer is kept as
+// bytes so that members of any type share one binding type.
+template <typename T>
+struct PropertyBinding {
+	typedef int (*getter_type)(lua_State*, T*, PropertyBinding const&);
+	typedef bool (*setter_type)(lua_State*, T*, PropertyBinding const&, int);
+
+	std::string name;
+	getter_type get;
+	setter_type set; // nullptr when read-only
+	unsigned char member[2 * sizeof(void*)];
+	void const* inherited; // The PropertyBinding of a base class this one forwards to
+
+	template <typename TMember>
+	TMember T::*memberPointer() const {
+		TMember T::*p;
+		std::memcpy(&p, member, sizeof(p));
+		return p;
+	}
+};
+
+template <typename T, typename TMember>
+struct PropertyAccess {
+	static int Get(lua_State* s, T* object, PropertyBinding<T> const& binding) {
+		TMember T::*p = binding.template memberPointer<TMember>();
+		return WithState(s, [object, p](Lua::State& state) -> int {
+			return static_cast<int>(TypeConverter<typename std::remove_cv<TMember>::type>::Push(state, object->*p));
+		});
+	}
+	static bool Set(lua_State* s, T* object, PropertyBinding<T> const& binding, int index) {
+		TMember T::*p = binding.template memberPointer<TMember>();
+		return WithState(s, [object, p, index](Lua::State& state) -> int {
+			auto value = TypeConverter<TMember>::Read(state, index);
+			if(!value)
+				return 0;
+			object->*p = std::move(*value);
+			return 1;
+		}) != 0;
+	}
+};
+
+// Defined in Operators.hpp.
+template <typename T, Operator op, typename... TOperands>
+struct ArithmeticMetamethod;
+template <typename T, CompareOp op, typename... TOperands>
+struct ComparisonMetamethod;
+template <typename T>
+struct LengthMetamethod;
+template <typename T>
+struct ToStringMetamethod;
+template <typename T, auto F>
+struct CloseMetamethod;
+
+// A property of a base class, reached through an upcast.
+template <typename T, typename TBase>
+struct InheritedProperty {
+	static int Get(lua_State* s, T* object, PropertyBinding<T> const& binding) {
+		PropertyBinding<TBase> const& base = *static_cast<PropertyBinding<TBase> const*>(binding.inherited);
+		return base.get(s, static_cast<TBase*>(object), base);
+	}
+	static bool Set(lua_State* s, T* object, PropertyBinding<T> const& binding, int index) {
+		PropertyBinding<TBase> const& base = *static_cast<PropertyBinding<TBase> const*>(binding.inherited);
+		return base.set(s, static_cast<TBase*>(object), base, index);
+	}
+};
+
+template <typename T>
+class MemberStorage : public std::map<std::string, ClassMemberFunctor<T>> {
+	std::vector<PropertyBinding<T>> m_properties;
+	lua_CFunction m_index    = nullptr;
+	lua_CFunction m_newindex = nullptr;
+
+	bool hasProperty(std::string const& name) const {
+		for(PropertyBinding<T> const& property : m_properties)
+			if(property.name == name)
+				return true;
+		return false;
+	}
+
+public:
+	// Copies the methods, metamethods and properties of a base class
+	// that this class does not define itself.
+	template <typename TBase>
+	void inherit(MemberStorage<TBase> const& base) {
+		static_assert(std::is_base_of<TBase, T>::value, "Lua::member_function_storage::inherit expects a base class.");
+
+		for(auto const& entry : base) {
+			if(this->count(entry.first) || hasProperty(entry.first))
+				continue;
+			if(lua_CFunction cfunction = entry.second.cfunction())
+				this->emplace(entry.first, cfunction);
+			else
+				this->emplace(entry.first, entry.second.functor());
+		}
+		for(PropertyBinding<TBase> const& property : base.properties()) {
+			if(this->count(property.name) || hasProperty(property.name))
+				continue;
+
+			PropertyBinding<T> binding {};
+			binding.name      = property.name;
+			binding.get       = &InheritedProperty<T, TBase>::Get;
+			binding.set       = property.set ? &InheritedProperty<T, TBase>::Set : nullptr;
+			binding.inherited = &property;
+			m_properties.push_back(std::move(binding));
+		}
+		if(!m_index)
+			m_index = base.indexFallback();
+		if(!m_newindex)
+			m_newindex = base.newindexFallback();
+	}
+
+	// Exposes a data member as obj.name; const members are always read-only.
+	template <typename TMember>
+	MemberStorage& property(std::string name, TMember T::*member, bool readonly = false) {
+		static_assert(!std::is_function<TMember>::value, "Lua::member_function_storage::property expects a data member pointer.");
+		static_assert(sizeof(member) <= sizeof(PropertyBinding<T>::member), "Unsupported member pointer representation.");
+
+		PropertyBinding<T> binding {};
+		binding.name = std::move(name);
+		binding.get  = &PropertyAccess<T, TMember>::Get;
+		if constexpr(!std::is_const<TMember>::value) {
+			if(!readonly)
+				binding.set = &PropertyAccess<T, TMember>::Set;
+		}
+		std::memcpy(binding.member, &member, sizeof(member));
+		m_properties.push_back(std::move(binding));
+		return *this;
+	}
+
+	std::vector<PropertyBinding<T>> const& properties() const { return m_properties; }
+
+	// Handlers for the keys that are neither methods nor properties,
+	// called with the object and the key (and the value for newindex).
+	MemberStorage& fallback(lua_CFunction index, lua_CFunction newindex = nullptr) {
+		m_index    = index;
+		m_newindex = newindex;
+		return *this;
+	}
+	lua_CFunction indexFallback() const { return m_index; }
+	lua_CFunction newindexFallback() const { return m_newindex; }
+
+	// Metamethods. Names starting with __ are installed on the metatable,
+	// except for __gc, __index, __newindex and __name.
+	MemberStorage& metamethod(std::string name, lua_CFunction function) {
+		(*this)[std::move(name)] = function;
+		return *this;
+	}
+	// The other operand may be any of TOperands, on either side; T by default.
+	template <Operator op, typename... TOperands>
+	MemberStorage& arithmetic() {
+		return metamethod(ArithmeticMetamethod<T, op, TOperands...>::Name(), &ArithmeticMetamethod<T, op, TOperands...>::Call);
+	}
+	template <CompareOp op, typename... TOperands>
+	MemberStorage& comparison() {
+		return metamethod(ComparisonMetamethod<T, op, TOperands...>::Name(), &ComparisonMetamethod<T, op, TOperands...>::Call);
+	}
+	// #obj is obj.size().
+	MemberStorage& length() { return metamethod("__len", &LengthMetamethod<T>::Call); }
+	// tostring(obj) uses operator<<.
+	MemberStorage& tostring() { return metamethod("__tostring", &ToStringMetamethod<T>::Call); }
+	// Called when a to-be-closed variable holding the object goes out of scope.
+	template <auto F>
+	MemberStorage& close() {
+		return metamethod("__close", &CloseMetamethod<T, F>::Call);
+	}
+};
+
 template <typename T>
-using member_function_storage = std::map<std::string, impl::ClassMemberFunctor<T>>;
+using member_function_storage = MemberStorage<T>;
+
+// Optional descriptor members, read with a default when they are missing.
+template <typename TDescriptor, typename = void>
+struct DescriptorDirectIndex : std::false_type {};
+template <typename TDescriptor>
+struct DescriptorDirectIndex<TDescriptor, std::void_t<decltype(TDescriptor::direct_index)>> : std::bool_constant<TDescriptor::direct_index> {};
+
+template <typename TDescriptor, typename = void>
+struct DescriptorBases {
+	typedef std::tuple<> type;
+};
+template <typename TDescriptor>
+struct DescriptorBases<TDescriptor, std::void_t<typename TDescriptor::bases>> {
+	typedef typename TDescriptor::bases type;
+};
+template <typename TDescriptor, typename = void>
+struct DescriptorMethods {
+	static constexpr luaL_Reg const* get() { return nullptr; }
+};
+template <typename TDescriptor>
+struct DescriptorMethods<TDescriptor, std::void_t<decltype(TDescriptor::methods)>> {
+	static constexpr luaL_Reg const* get() { return TDescriptor::methods; }
+};
+template <typename TDescriptor, typename = void>
+struct DescriptorHasMetatable : std::false_type {};
+template <typename TDescriptor>
+struct DescriptorHasMetatable<TDescriptor, std::void_t<decltype(&TDescriptor::metatable)>> : std::true_type {};
+template <typename TDescriptor, typename = void>
+struct DescriptorPooled : std::false_type {};
+template <typename TDescriptor>
+struct DescriptorPooled<TDescriptor, std::void_t<decltype(TDescriptor::pooled)>> : std::bool_constant<TDescriptor::pooled> {};
 
 template <typename T>
 struct MetatableDescriptorImpl {
+	typedef typename DescriptorBases<MetatableDescriptor<T>>::type bases;
+
 	// If you get an error here, then most likely the mentioned type
 	// doesn't have a dedicated metatable! Please write one!
 	static char const* name() { return MetatableDescriptor<T>::name(); }
 	static char const* constructor() { return MetatableDescriptor<T>::constructor(); }
 	static char const* luaname() { return MetatableDescriptor<T>::luaname(); }
 	static bool construct(T* location) { return MetatableDescriptor<T>::construct(location); }
-	static void metatable(member_function_storage<T>*& dest) {
-		static member_function_storage<T> mt;
-		if(mt.empty())
-			MetatableDescriptor<T>::metatable(mt);
+	static constexpr bool direct_index() { return DescriptorDirectIndex<MetatableDescriptor<T>>::value; }
+	static constexpr bool pooled() { return DescriptorPooled<MetatableDescriptor<T>>::value; }
+	// The constant method table, or nullptr.
+	static constexpr luaL_Reg const* methods() { return DescriptorMethods<MetatableDescriptor<T>>::get(); }
+	static constexpr int methodCount() {
+		int count = 0;
+		if(luaL_Reg const* reg = methods())
+			for(; reg[count].name; ++count) {}
+		return count;
+	}
+	// Built once, thread-safely, on first use by any State.
+	static void metatable(member_function_storage<T> const*& dest) {
+		static member_function_storage<T> const mt = [] {
+			member_function_storage<T> storage;
+			if constexpr(DescriptorHasMetatable<MetatableDescriptor<T>>::value)
+				MetatableDescriptor<T>::metatable(storage);
+			Inherit(storage, static_cast<bases*>(nullptr));
+			return storage;
+		}();
 		dest = &mt;
 	}
+
+private:
+	// Flattens the bases, in declaration order, so that lookups never walk the hierarchy.
+	template <typename... TBases>
+	static void Inherit(member_function_storage<T>& storage, std::tuple<TBases...>*) {
+		(InheritFrom<TBases>(storage), ...);
+	}
+	template <typename TBase>
+	static void InheritFrom(member_function_storage<T>& storage) {
+		member_function_storage<TBase> const* base = nullptr;
+		MetatableDescriptorImpl<TBase>::metatable(base);
+		storage.inherit(*base);
+	}
+};
+
+enum ObjectMode : unsigned char {
+	OM_INLINE,   // The object lives in the userdata
+	OM_BORROWED, // The object is owned by C++
+	OM_SHARED,   // The userdata holds a std::shared_ptr to the object
+	OM_POOLED    // The object lives in the ObjectPool of its type in the State
+};
+
+// Every userdata of a bound type starts with this header,
+// followed by the object or the std::shared_ptr when there is one.
+struct ObjectHeader {
+	void* object;
+	ObjectMode mode;
+};
+template <typename T>
+constexpr std::size_t PayloadOffset() {
+	return (sizeof(ObjectHeader) + alignof(T) - 1) / alignof(T) * alignof(T);
+}
+
+typedef void* (*UpcastFunction)(void*);
+template <typename T, typename TBase>
+struct Upcast {
+	static void* Cast(void* p) { return static_cast<TBase*>(static_cast<T*>(p)); }
+	static inline UpcastFunction const function = &Cast;
 };
 
 template <typename T>
 class MetatableManager {
 	typedef impl::MetatableDescriptorImpl<T> metatable;
 
+	template <typename>
+	friend class MetatableManager;
+
+	// The metatable is also stored in the registry under this address,
+	// so that type checks never look it up by name.
+	static inline char const s_metatableKey = 0;
+	// Set in the registry of States where the type was registered lazily.
+	static inline char const s_lazyKey = 0;
+	// Weak-valued table from the address of borrowed and shared objects
+	// to their userdata, so that pushing them again allocates nothing.
+	static inline char const s_cacheKey = 0;
+
 	static int RegisterMetatable(lua_State* state) {
 		int count = RegisterLoneMetatable(state);
 
@@ -104,126 +398,478 @@ class MetatableManager {
 	}
 	static int RegisterLoneMetatable(lua_State* state) {
 		luaL_newmetatable(state, metatable::name());
+		lua_pushvalue(state, -1);
+		lua_rawsetp(state, LUA_REGISTRYINDEX, &s_metatableKey);
+		CacheMetatable(state, lua_topointer(state, -1));
 		lua_pushcfunction(state, &MetatableManager::Destroy);
 		lua_setfield(state, -2, "__gc");
+		RegisterUpcasts(state, static_cast<typename metatable::bases*>(nullptr));
 
-		member_function_storage<T>* mtPtr = nullptr;
+		member_function_storage<T> const* mtPtr = nullptr;
 		metatable::metatable(mtPtr);
+
+		// Methods live in their own table, so that metamethods such as
+		// __gc are never reachable as obj.__gc.
+		lua_createtable(state, 0, metatable::methodCount() + (mtPtr ? static_cast<int>(mtPtr->size()) : 0));
+		if(luaL_Reg const* methods = metatable::methods())
+			luaL_setfuncs(state, methods, 0);
 		if(mtPtr) {
 			for(auto it = mtPtr->begin(); it != mtPtr->end(); ++it) {
-				std::string const& fncName              = it->first;
-				std::function<int(Lua::State&)> functor = it->second.functor();
+				std::string const& fncName = it->first;
 
-				if(fncName.empty() || (fncName.length() >= 2 && fncName[0] == '_' && fncName[1] == '_'))
+				if(fncName.empty())
 					continue;
-
-				int success = impl::Functor::Push(state, functor);
-				if(!success)
+				// Metamethods go on the metatable, the others in the methods table.
+				bool const isMetamethod = fncName.length() >= 2 && fncName[0] == '_' && fncName[1] == '_';
+				if(isMetamethod && !IsUserMetamethod(fncName))
 					continue;
-				lua_setfield(state, -2, fncName.c_str());
+				if(PushStored(state, it->second))
+					lua_setfield(state, isMetamethod ? -3 : -2, fncName.c_str());
 			}
 		}
 
-		lua_pushcfunction(state, &MetatableManager::Index);
+		if(mtPtr && (!mtPtr->properties().empty() || mtPtr->indexFallback() || mtPtr->newindexFallback())) {
+			// Methods are looked up first; other keys go through the property
+			// index, then the fallbacks.
+			if(!mtPtr->properties().empty()) {
+				std::vector<std::string_view> names;
+				names.reserve(mtPtr->properties().size());
+				for(PropertyBinding<T> const& property : mtPtr->properties())
+					names.push_back(property.name);
+				impl::PropertyIndex::Push(state, names);
+			}
+			else
+				lua_pushnil(state);
+
+			lua_pushvalue(state, -1);
+			PushFallback(state, mtPtr->newindexFallback());
+			lua_pushcclosure(state, &MetatableManager::NewIndex, 2);
+			lua_setfield(state, -4, "__newindex");
+			PushFallback(state, mtPtr->indexFallback());
+			lua_pushcclosure(state, &MetatableManager::IndexProperties, 3);
+		}
+		// With direct_index the VM resolves methods without entering C.
+		else if(!metatable::direct_index())
+			lua_pushcclosure(state, &MetatableManager::Index, 1);
 		lua_setfield(state, -2, "__index");
 		lua_pop(state, 1);
 
 		markAllocation(AT_METATABLE, +1);
 		return 0;
 	}
-	static int Index(lua_State* state) {
-		T* p = (T*)(luaL_checkudata(state, 1, metatable::name()));
-		if(!p)
-			return 0;
+	// Stores, in the metatable on top of the stack, the upcast to every
+	// direct and indirect base of T, keyed by the metatable key of the base.
+	template <typename... TBases>
+	static void RegisterUpcasts([[maybe_unused]] lua_State* state, std::tuple<TBases...>*) {
+		((lua_pushlightuserdata(state, const_cast<UpcastFunction*>(&Upcast<T, TBases>::function)),
+		  lua_rawsetp(state, -2, MetatableManager<TBases>::Key()),
+		  RegisterUpcasts(state, static_cast<typename MetatableDescriptorImpl<TBases>::bases*>(nullptr))),
+		 ...);
+	}
+	// The storage outlives every State, so its functions are referenced
+	// rather than copied into a Functor. Pushes nothing for an empty entry.
+	static bool PushStored(lua_State* state, ClassMemberFunctor<T> const& function) {
+		if(lua_CFunction cfunction = function.cfunction())
+			lua_pushcfunction(state, cfunction);
+		else if(function.functor()) {
+			lua_pushlightuserdata(state, const_cast<std::function<int(Lua::State&)>*>(&function.functor()));
+			lua_pushcclosure(state, &MetatableManager::CallStored, 1);
+		}
+		else
+			return false;
+		return true;
+	}
+	// Metamethods the manager installs itself cannot be replaced.
+	static bool IsUserMetamethod(std::string const& name) { return name != "__gc" && name != "__index" && name != "__newindex" && name != "__name"; }
+	// Pushes the metatable, creating it first if the type was registered
+	// lazily; pushes nil if the type is not registered.
+	static void PushMetatable(lua_State* state) {
+		if(lua_rawgetp(state, LUA_REGISTRYINDEX, &s_metatableKey) != LUA_TNIL)
+			return;
+		lua_pop(state, 1);
 
-		luaL_getmetatable(state, metatable::name());
-		lua_pushvalue(state, 2);
-		lua_rawget(state, -2);
-		// lua_replace(state, -2);
+		bool const lazy = lua_rawgetp(state, LUA_REGISTRYINDEX, &s_lazyKey) != LUA_TNIL;
+		lua_pop(state, 1);
+		if(lazy)
+			RegisterLoneMetatable(state);
+		lua_rawgetp(state, LUA_REGISTRYINDEX, &s_metatableKey);
+	}
+	// __index of the placeholder constructor table of a lazily registered type.
+	// Fills the table in place, so that references to it stay valid.
+	static int IndexLazy(lua_State* state) {
+		PushMetatable(state);
+		lua_pop(state, 1);
 
+		luaL_Reg const reg[] = { { metatable::constructor(), &MetatableManager::ConstructLua }, { nullptr, nullptr } };
+		lua_pushvalue(state, 1);
+		luaL_setfuncs(state, reg, 0);
+		lua_pop(state, 1);
+		lua_pushnil(state);
+		lua_setmetatable(state, 1);
+
+		lua_pushvalue(state, 2);
+		lua_rawget(state, 1);
+		return 1;
+	}
+	// Calls the std::function in the first upvalue. It is inserted at
+	// index 1, where translated functions expect their Functor.
+	static int CallStored(lua_State* state) {
+		lua_pushvalue(state, lua_upvalueindex(1));
+		lua_insert(state, 1);
+		std::function<int(Lua::State&)> const* function = static_cast<std::function<int(Lua::State&)> const*>(lua_touserdata(state, 1));
+
+		int const results = WithState(state, [state, function](Lua::State& s) -> int {
+			return CatchExceptions(state, [function, &s] { return (*function)(s); });
+		});
+		return results < 0 ? lua_error(state) : results;
+	}
+	// The methods table is the first upvalue.
+	static int Index(lua_State* state) {
+		lua_pushvalue(state, 2);
+		lua_rawget(state, lua_upvalueindex(1));
 		return 1;
 	}
+	static void PushFallback(lua_State* state, lua_CFunction fallback) {
+		if(fallback)
+			lua_pushcfunction(state, fallback);
+		else
+			lua_pushnil(state);
+	}
+	// Position of the key at index 2 in the property index upvalue, or -1.
+	static int FindProperty(lua_State* state, int upvalue) {
+		auto const* index = static_cast<impl::PropertyIndex const*>(lua_touserdata(state, lua_upvalueindex(upvalue)));
+		return index ? index->Find(state, 2) : -1;
+	}
+	// The methods table, the property index and the index fallback are the upvalues.
+	static int IndexProperties(lua_State* state) {
+		lua_pushvalue(state, 2);
+		if(lua_rawget(state, lua_upvalueindex(1)) != LUA_TNIL)
+			return 1;
+
+		int const position = FindProperty(state, 2);
+		if(position < 0) {
+			lua_CFunction fallback = lua_tocfunction(state, lua_upvalueindex(3));
+			if(!fallback)
+				return 1;
+			lua_settop(state, 2);
+			return fallback(state);
+		}
+
+		T* p = FromStack(state, 1);
+		lua_pop(state, 1);
+		PropertyBinding<T> const& property = Properties()[position];
+		return property.get(state, p, property);
+	}
+	// The property index and the newindex fallback are the upvalues.
+	static int NewIndex(lua_State* state) {
+		T* p = FromStack(state, 1);
+
+		int const position = FindProperty(state, 1);
+		if(position < 0) {
+			if(lua_CFunction fallback = lua_tocfunction(state, lua_upvalueindex(2)))
+				return fallback(state);
+			return luaL_error(state, "%s has no property '%s'.", metatable::name(), luaL_tolstring(state, 2, nullptr));
+		}
+
+		PropertyBinding<T> const& property = Properties()[position];
+		if(!property.set)
+			return luaL_error(state, "Property '%s' of %s is read-only.", property.name.c_str(), metatable::name());
+		if(!property.set(state, p, property, 3))
+			return luaL_error(state, "Property '%s' of %s cannot be set to a %s value.", property.name.c_str(), metatable::name(), luaL_typename(state, 3));
+		return 0;
+	}
+	static std::vector<PropertyBinding<T>> const& Properties() {
+		member_function_storage<T> const* mtPtr = nullptr;
+		metatable::metatable(mtPtr);
+		return mtPtr->properties();
+	}
 	static int Destroy(lua_State* state) {
-		T* p = (T*)(luaL_checkudata(state, 1, metatable::name()));
-		if(p) {
-			try {
-				markAllocation(AT_UDATA, -1);
-				p->~T();
-			}
-			catch(lua_exception& e) {
-				return luaL_error(state, "C++ / Lua Exception thrown while destructing object %s.\n%s", metatable::name(), e.what());
-			}
-			catch(std::exception& e) {
-				return luaL_error(state, "C++ Exception thrown while destructing object %s.\n%s", metatable::name(), e.what());
+		ObjectHeader* header = HeaderFromStack(state, 1);
+		if(!header)
+			return 0;
+
+		int const status = CatchExceptions(state, [state, header] {
+			markAllocation(AT_UDATA, -1);
+			if(header->mode == OM_INLINE)
+				static_cast<T*>(header->object)->~T();
+			else if(header->mode == OM_SHARED)
+				SharedOf(header)->~shared_ptr();
+			else if(header->mode == OM_POOLED && header->object) {
+				static_cast<T*>(header->object)->~T();
+				Pool(state)->Release(header->object);
+				header->object = nullptr;
 			}
-			catch(...) {
-				return luaL_error(state, "Unknown C++ Exception thrown while destructing object %s.", metatable::name());
+			return 0;
+		}, "destructing", metatable::name());
+		return status < 0 ? lua_error(state) : 0;
+	}
+
+	// Index of T in the metatable and pool caches of each State.
+	static std::size_t TypeId() {
+		static std::size_t const id = impl::NextTypeId();
+		return id;
+	}
+	// The metatable of T in the State that owns state, cached at registration
+	// so that type checks compare addresses. Null if the State has none.
+	template <typename TState = Lua::State>
+	static void const* CachedMetatable(lua_State* state) {
+		TState const* owner  = TState::FromLuaState(state);
+		std::size_t const id = TypeId();
+		return owner && id < owner->m_metatables.size() ? owner->m_metatables[id] : nullptr;
+	}
+	template <typename TState = Lua::State>
+	static void CacheMetatable(lua_State* state, void const* address) {
+		TState* owner = TState::FromLuaState(state);
+		if(!owner)
+			return;
+		std::size_t const id = TypeId();
+		if(owner->m_metatables.size() <= id)
+			owner->m_metatables.resize(id + 1, nullptr);
+		owner->m_metatables[id] = address;
+	}
+	// The pool of T in the State that owns state, created on first use.
+	// Null if the State has none.
+	template <typename TState = Lua::State>
+	static ObjectPool<T>* Pool(lua_State* state) {
+		TState* owner = TState::FromLuaState(state);
+		if(!owner)
+			return nullptr;
+		std::size_t const id = TypeId();
+		if(owner->m_pools.size() <= id)
+			owner->m_pools.resize(id + 1);
+		if(!owner->m_pools[id])
+			owner->m_pools[id].reset(new ObjectPool<T>());
+		return static_cast<ObjectPool<T>*>(owner->m_pools[id].get());
+	}
+	// Whether the metatable on top of the stack is the one of T.
+	static bool IsOwnMetatable(lua_State* state) {
+		if(void const* address = CachedMetatable(state))
+			return lua_topointer(state, -1) == address;
+
+		// A lua_State without a Lua::State: compare with the registry entry.
+		lua_rawgetp(state, LUA_REGISTRYINDEX, &s_metatableKey);
+		bool const matches = lua_rawequal(state, -1, -2);
+		lua_pop(state, 1);
+		return matches;
+	}
+	// The userdata at arg, if it holds a T itself rather than a derived type.
+	static ObjectHeader* HeaderFromStack(lua_State* state, int arg) {
+		void* userdata = lua_touserdata(state, arg);
+		if(!userdata || !lua_getmetatable(state, arg))
+			return nullptr;
+		bool const matches = IsOwnMetatable(state);
+		lua_pop(state, 1);
+		return matches ? static_cast<ObjectHeader*>(userdata) : nullptr;
+	}
+
+	static T* ObjectOf(void* userdata) { return userdata ? static_cast<T*>(static_cast<ObjectHeader*>(userdata)->object) : nullptr; }
+	static std::shared_ptr<T>* SharedOf(ObjectHeader* header) {
+		return std::launder(reinterpret_cast<std::shared_ptr<T>*>(reinterpret_cast<char*>(header) + PayloadOffset<std::shared_ptr<T>>()));
+	}
+	// Pushes a userdata for a new T and returns the storage for it: in the
+	// pool of the State for pooled types, otherwise after the header.
+	static T* AllocateInline(lua_State* state) {
+		if constexpr(metatable::pooled()) {
+			if(ObjectPool<T>* pool = Pool(state)) {
+				// The collector does not see the pool, so every new slab
+				// counts as debt; otherwise dropped objects pile up in it.
+				if(pool->Full())
+					lua_gc(state, LUA_GCSTEP, static_cast<int>(ObjectPool<T>::SlabSize / 1024 + 1));
+				ObjectHeader* header = static_cast<ObjectHeader*>(lua_newuserdatauv(state, sizeof(ObjectHeader), 0));
+				header->mode         = OM_POOLED;
+				header->object       = nullptr; // In case Allocate throws
+				header->object       = pool->Allocate();
+				return static_cast<T*>(header->object);
 			}
 		}
-		return 0;
+		ObjectHeader* header = static_cast<ObjectHeader*>(lua_newuserdatauv(state, PayloadOffset<T>() + sizeof(T), 0));
+		header->object       = reinterpret_cast<char*>(header) + PayloadOffset<T>();
+		header->mode         = OM_INLINE;
+		return static_cast<T*>(header->object);
+	}
+	// Gives back the storage of a userdata whose object failed to construct.
+	static void Discard(lua_State* state, int index) {
+		ObjectHeader* header = static_cast<ObjectHeader*>(lua_touserdata(state, index));
+		if(header->mode == OM_POOLED && header->object) {
+			Pool(state)->Release(header->object);
+			header->object = nullptr;
+		}
+		markAllocation(AT_UDATA, -1);
+	}
+	// Raises the message on top of the stack, after giving back the userdata
+	// and the metatable below it, whose object failed to construct.
+	static int RaiseDiscarded(lua_State* state) {
+		Discard(state, -3);
+		lua_replace(state, -3);
+		lua_pop(state, 1);
+		return lua_error(state);
+	}
+	// Pushes the cached userdata of object; borrowing accepts any of them.
+	static bool PushCached(lua_State* state, void const* object, bool requireShared) {
+		if(lua_rawgetp(state, LUA_REGISTRYINDEX, &s_cacheKey) != LUA_TTABLE) {
+			lua_pop(state, 1);
+			return false;
+		}
+		if(lua_rawgetp(state, -1, object) == LUA_TUSERDATA && (!requireShared || static_cast<ObjectHeader*>(lua_touserdata(state, -1))->mode == OM_SHARED)) {
+			lua_remove(state, -2);
+			return true;
+		}
+		lua_pop(state, 2);
+		return false;
+	}
+	// Caches the userdata on top of the stack as the one of object.
+	static void Cache(lua_State* state, void const* object) {
+		if(lua_rawgetp(state, LUA_REGISTRYINDEX, &s_cacheKey) != LUA_TTABLE) {
+			lua_pop(state, 1);
+			lua_createtable(state, 0, 0);
+			lua_createtable(state, 0, 1);
+			lua_pushliteral(state, "v");
+			lua_setfield(state, -2, "__mode");
+			lua_setmetatable(state, -2);
+			lua_pushvalue(state, -1);
+			lua_rawsetp(state, LUA_REGISTRYINDEX, &s_cacheKey);
+		}
+		lua_pushvalue(state, -2);
+		lua_rawsetp(state, -2, object);
+		lua_pop(state, 1);
 	}
 
 public:
-	static T* FromStack(lua_State* state, int arg) { return (T*)luaL_checkudata(state, arg, metatable::name()); }
-	template <typename... Args>
-	static T* Construct(lua_State* state, Args&&... args) {
-		T* p = (T*)lua_newuserdata(state, sizeof(T));
+	// The pool of T in state; empty when no object was pooled there.
+	template <typename TState = Lua::State>
+	static PoolStatistics PoolStatisticsOf(TState const& state) {
+		std::size_t const id = TypeId();
+		if(id < state.m_pools.size() && state.m_pools[id])
+			return static_cast<ObjectPool<T> const*>(state.m_pools[id].get())->Statistics();
+		return PoolStatistics();
+	}
+
+	static void const* Key() { return &s_metatableKey; }
+	static T* FromStack(lua_State* state, int arg) {
+		T* p = TestStack(state, arg);
 		if(!p)
+			luaL_typeerror(state, arg, metatable::name());
+		return p;
+	}
+	// Objects of derived types are found through the upcast stored in their metatable.
+	static T* TestStack(lua_State* state, int arg) {
+		void* userdata = lua_touserdata(state, arg);
+		if(!userdata || !lua_getmetatable(state, arg))
 			return nullptr;
 
-		markAllocation(AT_UDATA, +1);
-		luaL_getmetatable(state, metatable::name());
-		try {
-			new(p) T(std::forward<Args>(args)...);
+		if(IsOwnMetatable(state)) {
+			lua_pop(state, 1);
+			return ObjectOf(userdata);
 		}
-		catch(lua_exception& e) {
-			lua_pop(state, 2);
-			luaL_error(state, "C++ / Lua Exception thrown while constructing object %s.\n%s", metatable::name(), e.what());
+
+		void* upcast = lua_rawgetp(state, -1, &s_metatableKey) == LUA_TLIGHTUSERDATA ? lua_touserdata(state, -1) : nullptr;
+		lua_pop(state, 2);
+		void* object = static_cast<ObjectHeader*>(userdata)->object;
+		if(!upcast || !object)
 			return nullptr;
-		}
-		catch(std::exception& e) {
-			lua_pop(state, 2);
-			luaL_error(state, "C++ Exception thrown while constructing object %s.\n%s", metatable::name(), e.what());
+		return static_cast<T*>((*static_cast<UpcastFunction const*>(upcast))(object));
+	}
+	// The std::shared_ptr held by the userdata at arg, if it holds one.
+	static std::shared_ptr<T> SharedFromStack(lua_State* state, int arg) {
+		ObjectHeader* header = HeaderFromStack(state, arg);
+		if(!header || header->mode != OM_SHARED)
 			return nullptr;
-		}
-		catch(...) {
-			lua_pop(state, 2);
-			luaL_error(state, "Unknown C++ Exception thrown while constructing object %s.", metatable::name());
+		return *SharedOf(header);
+	}
+	// Pushes a userdata referring to an object owned by C++, which must
+	// outlive every Lua reference to it. The same object always maps to
+	// the same userdata while that userdata is alive.
+	static T* PushBorrowed(lua_State* state, T* object) {
+		if(!object) {
+			lua_pushnil(state);
 			return nullptr;
 		}
+		if(PushCached(state, object, false))
+			return object;
 
+		ObjectHeader* header = static_cast<ObjectHeader*>(lua_newuserdatauv(state, sizeof(ObjectHeader), 0));
+		header->object       = object;
+		header->mode         = OM_BORROWED;
+		markAllocation(AT_UDATA, +1);
+		PushMetatable(state);
+		lua_setmetatable(state, -2);
+		Cache(state, object);
+		return object;
+	}
+	// Pushes a userdata sharing the ownership of object.
+	static T* PushShared(lua_State* state, std::shared_ptr<T> object) {
+		if(!object) {
+			lua_pushnil(state);
+			return nullptr;
+		}
+		T* p = object.get();
+		if(PushCached(state, p, true))
+			return p;
+
+		ObjectHeader* header = static_cast<ObjectHeader*>(lua_newuserdatauv(state, PayloadOffset<std::shared_ptr<T>>() + sizeof(std::shared_ptr<T>), 0));
+		header->object       = p;
+		header->mode         = OM_SHARED;
+		new(SharedOf(header)) std::shared_ptr<T>(std::move(object));
+		markAllocation(AT_UDATA, +1);
+		PushMetatable(state);
 		lua_setmetatable(state, -2);
+		Cache(state, p);
 		return p;
 	}
-	static int ConstructLua(lua_State* state) {
-		T* p = (T*)lua_newuserdata(state, sizeof(T));
+	template <typename... Args>
+	static T* Construct(lua_State* state, Args&&... args) {
+		T* p = AllocateInline(state);
 		if(!p)
-			return 0;
+			return nullptr;
 
 		markAllocation(AT_UDATA, +1);
-		luaL_getmetatable(state, metatable::name());
-		try {
-			if(!metatable::construct(p)) {
-				lua_pop(state, 2);
-				luaL_error(state, "C++ Error: Unable to construct object %s.\nUnknown error.", metatable::name());
-				return 0;
-			}
-		}
-		catch(lua_exception& e) {
-			lua_pop(state, 2);
-			luaL_error(state, "C++ / Lua Exception thrown while constructing object %s.\n%s", metatable::name(), e.what());
+		PushMetatable(state);
+		int const status = CatchExceptions(state, [p, &args...] {
+			new(p) T(std::forward<Args>(args)...);
 			return 0;
+		}, "constructing", metatable::name());
+		if(status < 0) {
+			RaiseDiscarded(state);
+			return nullptr;
 		}
-		catch(std::exception& e) {
-			lua_pop(state, 2);
-			luaL_error(state, "C++ Exception thrown while constructing object %s.\n%s", metatable::name(), e.what());
-			return 0;
+
+		lua_setmetatable(state, -2);
+		return p;
+	}
+	// Pushes an object initialised from make(), constructed in place.
+	// Exceptions propagate; the userdata is then left without a metatable.
+	template <typename F>
+	static T* Emplace(lua_State* state, F const& make) {
+		T* object = AllocateInline(state);
+		markAllocation(AT_UDATA, +1);
+		try {
+			new(object) T(make());
 		}
 		catch(...) {
-			lua_pop(state, 2);
-			luaL_error(state, "Unknown C++ Exception thrown while constructing object %s.", metatable::name());
-			return 0;
+			Discard(state, -1);
+			throw;
 		}
+		PushMetatable(state);
+		lua_setmetatable(state, -2);
+		return object;
+	}
+	static int ConstructLua(lua_State* state) {
+		T* p = AllocateInline(state);
+		if(!p)
+			return 0;
+
+		markAllocation(AT_UDATA, +1);
+		PushMetatable(state);
+		int const status = CatchExceptions(state, [p, state] {
+			if(metatable::construct(p))
+				return 0;
+			luaL_where(state, 1);
+			lua_pushfstring(state, "C++ Error: Unable to construct object %s.\nUnknown error.", metatable::name());
+			lua_concat(state, 2);
+			return -1;
+		}, "constructing", metatable::name());
+		if(status < 0)
+			return RaiseDiscarded(state);
 
 		lua_setmetatable(state, -2);
 		return 1;
@@ -241,12 +887,42 @@ public:
 		luaL_requiref(state, lname.c_str(), allowConstructor ? &MetatableManager::RegisterMetatable : &MetatableManager::RegisterLoneMetatable, allowConstructor ? 1 : 0);
 		lua_pop(state, 1);
 	}
+	// Only records the type. The metatable is built when the first object
+	// is pushed, and the constructor table when it is first indexed.
+	static void RegisterLazy(lua_State* state, bool allowConstructor = true) {
+		impl::Functor::Register(state);
+		lua_pushboolean(state, 1);
+		lua_rawsetp(state, LUA_REGISTRYINDEX, &s_lazyKey);
+
+		std::string lname  = metatable::luaname();
+		std::string constr = metatable::constructor();
+		if(!allowConstructor || lname.empty() || constr.empty())
+			return;
+
+		lua_createtable(state, 0, 1);
+		lua_createtable(state, 0, 1);
+		lua_pushcfunction(state, &MetatableManager::IndexLazy);
+		lua_setfield(state, -2, "__index");
+		lua_setmetatable(state, -2);
+
+		luaL_getsubtable(state, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+		lua_pushvalue(state, -2);
+		lua_setfield(state, -2, lname.c_str());
+		lua_pop(state, 1);
+		lua_setglobal(state, lname.c_str());
+	}
 };
 }
 
 template <typename T>
 using member_function_storage = impl::member_function_storage<T>;
 
+// Statistics of the pool of a bound type declared with pooled = true in state.
+template <typename T, typename TState>
+PoolStatistics GetPoolStatistics(TState const& state) {
+	return impl::MetatableManager<T>::PoolStatisticsOf(state);
+}
+
 template <typename T>
 bool DefaultConstructor(T* location) {
 	new(location) T();
@@ -0,0 +1,333 @@
+/*	Copyright (c) 2023 Mauro Grassia
+**	
+**	Permission is granted to use, modify and redistribute this software.
+**	Modified versions of this software MUST be marked as such.
+**	
+**	This software is provided "AS IS". In no event shall
+**	the authors or copyright holders be liable for any claim,
+**	damages or other liability. The above copyright notice
+**	and this permission notice shall be included in all copies
+**	or substantial portions of the software.
+**	
+*/
+
+#ifndef LUAPP_NUMERICARRAY_HPP
+#define LUAPP_NUMERICARRAY_HPP
+
+#include "LuaInclude.hpp"
+#include "State.hpp"
+#include "Transform.hpp"
+#include "TypeConverter.hpp"
+#include "MetatableManager.hpp"
+#include "Operators.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if __has_include(<version>)
+#	include <version>
+#endif
+#ifdef __cpp_lib_span
+#	include <span>
+#endif
+
+/*	A contiguous array of numbers, bound as a userdata:
+ *
+ *		s.luapp_register_object<Lua::NumericArray<float>>();
+ *		s.luapp_move_object(Lua::NumericArray<float>(std::move(samples)));
+ *
+ *	In Lua it is indexed from 1 and has a length; the elements are never
+ *	copied into tables. C++ functions take it as Lua::NumericArray<T>*, or
+ *	as std::span<T> where available. The kernels below are written as
+ *	plain loops over the storage so that the compiler can vectorize them.
+ */
+
+namespace Lua {
+
+template <typename T>
+class NumericArray {
+	static_assert(std::is_arithmetic<T>::value && !std::is_same<T, bool>::value, "Lua::NumericArray expects a numeric type.");
+
+	std::vector<T> m_data;
+
+public:
+	typedef T value_type;
+	// Sums of floating point values are kept in double; integer sums wrap
+	// around like Lua integers.
+	typedef typename std::conditional<std::is_floating_point<T>::value, double, unsigned long long>::type accumulator_type;
+
+	NumericArray() = default;
+	explicit NumericArray(std::size_t size, T value = T())
+		: m_data(size, value) {}
+	// Takes the storage of the vector, without copying.
+	explicit NumericArray(std::vector<T>&& data)
+		: m_data(std::move(data)) {}
+
+	// Gives the storage back; the array is left empty.
+	std::vector<T> release() { return std::move(m_data); }
+	std::vector<T> const& vector() const { return m_data; }
+
+	T* data() { return m_data.data(); }
+	T const* data() const { return m_data.data(); }
+	std::size_t size() const { return m_data.size(); }
+	bool empty() const { return m_data.empty(); }
+	void resize(std::size_t size) { m_data.resize(size); }
+
+	T* begin() { return m_data.data(); }
+	T* end() { return m_data.data() + m_data.size(); }
+	T const* begin() const { return m_data.data(); }
+	T const* end() const { return m_data.data() + m_data.size(); }
+
+	T& operator[](std::size_t i) { return m_data[i]; }
+	T const& operator[](std::size_t i) const { return m_data[i]; }
+
+#ifdef __cpp_lib_span
+	std::span<T> span() { return { m_data.data(), m_data.size() }; }
+	std::span<T const> span() const { return { m_data.data(), m_data.size() }; }
+#endif
+
+	accumulator_type sum() const {
+		return Reduce([p = data()](std::size_t i) { return static_cast<accumulator_type>(p[i]); });
+	}
+	accumulator_type dot(NumericArray const& other) const {
+		CheckSize(other, "dot");
+		return Reduce([p = data(), q = other.data()](std::size_t i) { return static_cast<accumulator_type>(p[i]) * static_cast<accumulator_type>(q[i]); });
+	}
+	std::optional<T> min() const {
+		if(empty())
+			return std::nullopt;
+		T const* p = data();
+		T result   = p[0];
+		for(std::size_t i = 1, n = size(); i < n; ++i)
+			result = p[i] < result ? p[i] : result;
+		return result;
+	}
+	std::optional<T> max() const {
+		if(empty())
+			return std::nullopt;
+		T const* p = data();
+		T result   = p[0];
+		for(std::size_t i = 1, n = size(); i < n; ++i)
+			result = result < p[i] ? p[i] : result;
+		return result;
+	}
+	// this += a * x
+	void axpy(T a, NumericArray const& x) {
+		CheckSize(x, "axpy");
+		T* __restrict p       = data();
+		T const* __restrict q = x.data();
+		for(std::size_t i = 0, n = size(); i < n; ++i)
+			p[i] = static_cast<T>(p[i] + a * q[i]);
+	}
+	void scale(T a) {
+		T* __restrict p = data();
+		for(std::size_t i = 0, n = size(); i < n; ++i)
+			p[i] = static_cast<T>(p[i] * a);
+	}
+	void fill(T value) { std::fill(m_data.begin(), m_data.end(), value); }
+
+private:
+	void CheckSize(NumericArray const& other, char const* operation) const {
+		if(other.size() != size())
+			throw std::invalid_argument(std::string("Lua::NumericArray::") + operation + ": arrays have different sizes.");
+	}
+	// Independent partial sums let the additions run in parallel.
+	template <typename F>
+	accumulator_type Reduce(F const& term) const {
+		accumulator_type partial[4] = {};
+		std::size_t const n         = size();
+		std::size_t i               = 0;
+		for(; i + 4 <= n; i += 4) {
+			partial[0] += term(i);
+			partial[1] += term(i + 1);
+			partial[2] += term(i + 2);
+			partial[3] += term(i + 3);
+		}
+		for(; i < n; ++i)
+			partial[0] += term(i);
+		return (partial[0] + partial[1]) + (partial[2] + partial[3]);
+	}
+};
+
+namespace impl {
+
+template <typename T>
+struct NumericArrayName;
+
+#define LUAPP_NUMERIC_ARRAY_NAME(type, lua)                                 \
+	template <>                                                             \
+	struct NumericArrayName<type> {                                         \
+		static char const* name() { return "luapp_numeric_array_" lua; } \
+		static char const* luaname() { return lua; }                        \
+	};
+
+LUAPP_NUMERIC_ARRAY_NAME(float, "FloatArray")
+LUAPP_NUMERIC_ARRAY_NAME(double, "DoubleArray")
+LUAPP_NUMERIC_ARRAY_NAME(std::int8_t, "Int8Array")
+LUAPP_NUMERIC_ARRAY_NAME(std::int16_t, "Int16Array")
+LUAPP_NUMERIC_ARRAY_NAME(std::int32_t, "Int32Array")
+LUAPP_NUMERIC_ARRAY_NAME(std::int64_t, "Int64Array")
+LUAPP_NUMERIC_ARRAY_NAME(std::uint8_t, "UInt8Array")
+LUAPP_NUMERIC_ARRAY_NAME(std::uint16_t, "UInt16Array")
+LUAPP_NUMERIC_ARRAY_NAME(std::uint32_t, "UInt32Array")
+LUAPP_NUMERIC_ARRAY_NAME(std::uint64_t, "UInt64Array")
+
+#undef LUAPP_NUMERIC_ARRAY_NAME
+
+// The Lua side of NumericArray<T>. Elements cross the boundary as Lua
+// numbers or integers, whatever the width of T.
+template <typename T>
+struct NumericArrayMethods {
+	typedef NumericArray<T> array_type;
+	typedef MetatableManager<array_type> manager;
+	typedef typename std::conditional<std::is_floating_point<T>::value, lua_Number, lua_Integer>::type lua_value;
+
+	static void PushElement(lua_State* state, T value) {
+		if constexpr(std::is_floating_point<T>::value)
+			lua_pushnumber(state, static_cast<lua_Number>(value));
+		else
+			lua_pushinteger(state, static_cast<lua_Integer>(value));
+	}
+	static bool ReadElement(lua_State* state, int arg, T& value) {
+		int isnum = 0;
+		if constexpr(std::is_floating_point<T>::value)
+			value = static_cast<T>(lua_tonumberx(state, arg, &isnum));
+		else
+			value = static_cast<T>(lua_tointegerx(state, arg, &isnum));
+		return isnum != 0;
+	}
+	// 1-based position of the key at arg, or 0 when it is outside the array.
+	static std::size_t Position(lua_State* state, array_type const& array, int arg) {
+		if(lua_type(state, arg) != LUA_TNUMBER)
+			return 0;
+		int isnum       = 0;
+		lua_Integer key = lua_tointegerx(state, arg, &isnum);
+		if(!isnum || key < 1 || static_cast<lua_Unsigned>(key) > array.size())
+			return 0;
+		return static_cast<std::size_t>(key);
+	}
+
+	static int Index(lua_State* state) {
+		array_type* array = manager::FromStack(state, 1);
+		std::size_t const position = Position(state, *array, 2);
+		if(!position)
+			return 0;
+		PushElement(state, (*array)[position - 1]);
+		return 1;
+	}
+	static int NewIndex(lua_State* state) {
+		array_type* array = manager::FromStack(state, 1);
+		std::size_t const position = Position(state, *array, 2);
+		if(!position)
+			return luaL_error(state, "%s index %s is out of range (size %d).", NumericArrayName<T>::luaname(), luaL_tolstring(state, 2, nullptr), static_cast<int>(array->size()));
+
+		T value;
+		if(!ReadElement(state, 3, value))
+			return luaL_error(state, "%s elements cannot be set to a %s value.", NumericArrayName<T>::luaname(), luaL_typename(state, 3));
+		(*array)[position - 1] = value;
+		return 0;
+	}
+
+	static lua_Integer Size(array_type* array) { return static_cast<lua_Integer>(array->size()); }
+	static void Resize(array_type* array, lua_Integer size) {
+		if(size < 0)
+			throw std::invalid_argument("Lua::NumericArray::resize: negative size.");
+		array->resize(static_cast<std::size_t>(size));
+	}
+	static lua_value Sum(array_type* array) { return static_cast<lua_value>(array->sum()); }
+	static lua_value Dot(array_type* array, array_type* other) { return static_cast<lua_value>(array->dot(*other)); }
+	static std::optional<lua_value> Min(array_type* array) {
+		if(std::optional<T> value = array->min())
+			return static_cast<lua_value>(*value);
+		return std::nullopt;
+	}
+	static std::optional<lua_value> Max(array_type* array) {
+		if(std::optional<T> value = array->max())
+			return static_cast<lua_value>(*value);
+		return std::nullopt;
+	}
+	static void Axpy(array_type* array, lua_value a, array_type* x) { array->axpy(static_cast<T>(a), *x); }
+	static void Scale(array_type* array, lua_value a) { array->scale(static_cast<T>(a)); }
+	static void Fill(array_type* array, lua_value value) { array->fill(static_cast<T>(value)); }
+
+	// array:map(f) returns a new array of f(x) for every element x.
+	static int Map(lua_State* state) {
+		array_type* array = manager::FromStack(state, 1);
+		luaL_checktype(state, 2, LUA_TFUNCTION);
+
+		std::size_t const size = array->size();
+		CallOperator(state, "map", [size](Lua::State& s) -> int {
+			manager::Emplace(s.GetState(), [size]() { return array_type(size); });
+			return 1;
+		});
+		array_type* result = manager::FromStack(state, -1);
+
+		for(std::size_t i = 0; i < size; ++i) {
+			// f may resize the array, which would leave the rest behind.
+			if(i >= array->size())
+				return luaL_error(state, "%s:map: the function shrank the array.", NumericArrayName<T>::luaname());
+			lua_pushvalue(state, 2);
+			PushElement(state, (*array)[i]);
+			lua_call(state, 1, 1);
+			if(!ReadElement(state, -1, (*result)[i]))
+				return luaL_error(state, "%s:map expects numbers, got a %s value.", NumericArrayName<T>::luaname(), luaL_typename(state, -1));
+			lua_pop(state, 1);
+		}
+		return 1;
+	}
+};
+
+}
+
+#ifdef __cpp_lib_span
+// A NumericArray passed to C++ as a view of its elements, without copying.
+template <typename T>
+struct TypeConverter<std::span<T>> {
+	typedef NumericArray<typename std::remove_const<T>::type> array_type;
+	typedef std::optional<std::span<T>> Arg;
+
+	static Arg Read(Lua::State& s, int id) {
+		array_type* array = impl::MetatableManager<array_type>::TestStack(s.GetState(), id);
+		if(!array)
+			return std::nullopt;
+		return std::span<T>(array->data(), array->size());
+	}
+	static std::string Name() { return impl::NumericArrayName<typename std::remove_const<T>::type>::name(); }
+	static char const* TypeName() { return impl::NumericArrayName<typename std::remove_const<T>::type>::name(); }
+};
+#endif
+
+}
+
+template <typename T>
+struct MetatableDescriptor<Lua::NumericArray<T>> {
+	typedef Lua::impl::NumericArrayMethods<T> methods_type;
+
+	static char const* name() { return Lua::impl::NumericArrayName<T>::name(); }
+	static char const* luaname() { return Lua::impl::NumericArrayName<T>::luaname(); }
+	static char const* constructor() { return "new"; }
+	static bool construct(Lua::NumericArray<T>* p) { return Lua::DefaultConstructor(p); }
+	static constexpr luaL_Reg methods[] = {
+		{ "size", Lua::Transform<&methods_type::Size>() },
+		{ "resize", Lua::Transform<&methods_type::Resize>() },
+		{ "sum", Lua::Transform<&methods_type::Sum>() },
+		{ "min", Lua::Transform<&methods_type::Min>() },
+		{ "max", Lua::Transform<&methods_type::Max>() },
+		{ "dot", Lua::Transform<&methods_type::Dot>() },
+		{ "axpy", Lua::Transform<&methods_type::Axpy>() },
+		{ "scale", Lua::Transform<&methods_type::Scale>() },
+		{ "fill", Lua::Transform<&methods_type::Fill>() },
+		{ "map", &methods_type::Map },
+		{ nullptr, nullptr }
+	};
+	static void metatable(Lua::member_function_storage<Lua::NumericArray<T>>& mt) {
+		mt.length().fallback(&methods_type::Index, &methods_type::NewIndex);
+	}
+};
+
+#endif
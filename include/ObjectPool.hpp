@@ -0,0 +1,161 @@
+/*	Copyright (c) 2023 Mauro Grassia
+**	
+**	Permission is granted to use, modify and redistribute this software.
+**	Modified versions of this software MUST be marked as such.
+**	
+**	This software is provided "AS IS". In no event shall
+**	the authors or copyright holders be liable for any claim,
+**	damages or other liability. The above copyright notice
+**	and this permission notice shall be included in all copies
+**	or substantial portions of the software.
+**	
+*/
+
+#ifndef LUAPP_OBJECTPOOL_HPP
+#define LUAPP_OBJECTPOOL_HPP
+
+#include <algorithm>
+#include <cstddef>
+
+namespace Lua {
+
+struct PoolStatistics {
+	std::size_t slabs       = 0; // Slabs currently held
+	std::size_t capacity    = 0; // Objects that fit in them
+	std::size_t live        = 0; // Objects currently in use
+	std::size_t allocations = 0; // Objects handed out since the State opened
+};
+
+namespace impl {
+
+// The pools of a State, by type id; see MetatableManager::Pool.
+class ObjectPoolBase {
+public:
+	virtual ~ObjectPoolBase() = default;
+};
+
+// Storage for the objects of a pooled bound type in one State: fixed-size
+// slabs, each with its own free list. The State owns the pool and frees it
+// in close(), after lua_close has collected the objects, so no locking is
+// needed. Slabs with room are listed partly used first and empty last;
+// empty slabs are freed while more than half of the pool is spare, so that
+// churn does not reallocate them.
+template <typename T>
+class ObjectPool : public ObjectPoolBase {
+	struct Slab;
+	struct Slot {
+		Slab* slab;
+		union {
+			Slot* next;
+			alignas(T) unsigned char storage[sizeof(T)];
+		};
+	};
+	static constexpr std::size_t SlotsPerSlab = std::max<std::size_t>(16, 4096 / sizeof(Slot));
+	struct Slab {
+		Slot slots[SlotsPerSlab];
+		Slot* free;
+		std::size_t live;
+		Slab* previous; // In the list of slabs with room
+		Slab* next;
+	};
+
+	Slab* m_first = nullptr; // Slabs with room
+	Slab* m_last  = nullptr;
+	PoolStatistics m_statistics;
+
+	void PushFront(Slab* slab) noexcept {
+		slab->previous = nullptr;
+		slab->next     = m_first;
+		(m_first ? m_first->previous : m_last) = slab;
+		m_first = slab;
+	}
+	void PushBack(Slab* slab) noexcept {
+		slab->previous = m_last;
+		slab->next     = nullptr;
+		(m_last ? m_last->next : m_first) = slab;
+		m_last = slab;
+	}
+	void Unlink(Slab* slab) noexcept {
+		(slab->previous ? slab->previous->next : m_first) = slab->next;
+		(slab->next ? slab->next->previous : m_last)      = slab->previous;
+	}
+	void Grow() {
+		Slab* slab = new Slab;
+		slab->free = nullptr;
+		slab->live = 0;
+		for(std::size_t i = SlotsPerSlab; i-- > 0;) {
+			slab->slots[i].slab = slab;
+			slab->slots[i].next = slab->free;
+			slab->free          = &slab->slots[i];
+		}
+		PushBack(slab);
+		++m_statistics.slabs;
+		m_statistics.capacity += SlotsPerSlab;
+	}
+	void Free(Slab* slab) noexcept {
+		Unlink(slab);
+		delete slab;
+		--m_statistics.slabs;
+		m_statistics.capacity -= SlotsPerSlab;
+	}
+	bool MostlySpare() const noexcept {
+		return m_statistics.capacity - m_statistics.live > std::max(m_statistics.live, SlotsPerSlab);
+	}
+	static Slot* SlotOf(void* p) noexcept {
+		return reinterpret_cast<Slot*>(static_cast<unsigned char*>(p) - offsetof(Slot, storage));
+	}
+
+public:
+	static constexpr std::size_t SlabSize = sizeof(Slab);
+
+	ObjectPool() = default;
+	ObjectPool(ObjectPool const&)            = delete;
+	ObjectPool& operator=(ObjectPool const&) = delete;
+	~ObjectPool() override {
+		while(m_first)
+			Free(m_first);
+		// Slabs that are still full hold objects that were never
+		// released; they are unreachable once the State is closed.
+	}
+
+	// Uninitialised storage for one T.
+	void* Allocate() {
+		if(!m_first)
+			Grow();
+
+		Slab* slab = m_first;
+		Slot* slot = slab->free;
+		slab->free = slot->next;
+		if(!slab->free)
+			Unlink(slab);
+		++slab->live;
+		++m_statistics.live;
+		++m_statistics.allocations;
+		return slot->storage;
+	}
+	// Returns storage from Allocate; the object must already be destroyed.
+	void Release(void* p) noexcept {
+		Slot* slot = SlotOf(p);
+		Slab* slab = slot->slab;
+		if(!slab->free)
+			PushFront(slab);
+		slot->next = slab->free;
+		slab->free = slot;
+		--m_statistics.live;
+		if(!--slab->live && slab != m_last) {
+			Unlink(slab);
+			PushBack(slab);
+		}
+		while(m_last && !m_last->live && MostlySpare())
+			Free(m_last);
+	}
+	// Whether the next Allocate adds a slab.
+	bool Full() const noexcept { return !m_first; }
+	PoolStatistics const& Statistics() const noexcept { return m_statistics; }
+};
+
+}
+
+}
+
+#endif
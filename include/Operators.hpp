@@ -0,0 +1,281 @@
+/*	Copyright (c) 2023 Mauro Grassia
+**	
+**	Permission is granted to use, modify and redistribute this software.
+**	Modified versions of this software MUST be marked as such.
+**	
+**	This software is provided "AS IS". In no event shall
+**	the authors or copyright holders be liable for any claim,
+**	damages or other liability. The above copyright notice
+**	and this permission notice shall be included in all copies
+**	or substantial portions of the software.
+**	
+*/
+
+#ifndef LUAPP_OPERATORS_HPP
+#define LUAPP_OPERATORS_HPP
+
+#include "LuaInclude.hpp"
+#include "Enums.hpp"
+#include "State.hpp"
+#include "TypeConverter.hpp"
+#include "MetatableManager.hpp"
+
+#include <exception>
+#include <functional>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+/*	Operator metamethods of bound types, generated from the C++ operators:
+ *
+ *		static void metatable(Lua::member_function_storage<Vector>& mt) {
+ *			mt.arithmetic<Lua::OP_ADD>();                 // v + v
+ *			mt.arithmetic<Lua::OP_MUL, Vector, double>(); // v * v, v * 2, 2 * v
+ *			mt.arithmetic<Lua::OP_UNM>();                 // -v
+ *			mt.comparison<Lua::IS_EQUAL>();
+ *			mt.length().tostring();
+ *		}
+ *
+ *	Each one is a plain lua_CFunction. Results of the bound type are
+ *	constructed in place in the new userdata.
+ */
+
+namespace Lua::impl {
+
+template <Operator op>
+struct OperatorTraits;
+
+#define LUAPP_BINARY_OPERATOR(op, metamethod, expression)                                  \
+	template <>                                                                            \
+	struct OperatorTraits<op> {                                                            \
+		static constexpr bool unary = false;                                               \
+		static char const* Name() { return metamethod; }                                   \
+		template <typename A, typename B>                                                  \
+		static auto Apply(A const& a, B const& b) -> decltype(expression) { return expression; } \
+	};
+#define LUAPP_UNARY_OPERATOR(op, metamethod, expression)                     \
+	template <>                                                              \
+	struct OperatorTraits<op> {                                              \
+		static constexpr bool unary = true;                                  \
+		static char const* Name() { return metamethod; }                     \
+		template <typename A, typename B>                                    \
+		static auto Apply(A const& a, B const&) -> decltype(expression) { return expression; } \
+	};
+
+LUAPP_BINARY_OPERATOR(OP_ADD, "__add", a + b)
+LUAPP_BINARY_OPERATOR(OP_SUB, "__sub", a - b)
+LUAPP_BINARY_OPERATOR(OP_MUL, "__mul", a * b)
+LUAPP_BINARY_OPERATOR(OP_DIV, "__div", a / b)
+LUAPP_BINARY_OPERATOR(OP_MOD, "__mod", a % b)
+LUAPP_BINARY_OPERATOR(OP_AND, "__band", a & b)
+LUAPP_BINARY_OPERATOR(OP_OR, "__bor", a | b)
+LUAPP_BINARY_OPERATOR(OP_XOR, "__bxor", a ^ b)
+LUAPP_BINARY_OPERATOR(OP_SHL, "__shl", a << b)
+LUAPP_BINARY_OPERATOR(OP_SHR, "__shr", a >> b)
+LUAPP_UNARY_OPERATOR(OP_UNM, "__unm", -a)
+LUAPP_UNARY_OPERATOR(OP_NOT, "__bnot", ~a)
+
+#undef LUAPP_BINARY_OPERATOR
+#undef LUAPP_UNARY_OPERATOR
+
+template <CompareOp op>
+struct CompareTraits;
+template <>
+struct CompareTraits<IS_EQUAL> {
+	static char const* Name() { return "__eq"; }
+	template <typename A, typename B>
+	static auto Apply(A const& a, B const& b) -> decltype(a == b) { return a == b; }
+};
+template <>
+struct CompareTraits<IS_LESS_THAN> {
+	static char const* Name() { return "__lt"; }
+	template <typename A, typename B>
+	static auto Apply(A const& a, B const& b) -> decltype(a < b) { return a < b; }
+};
+template <>
+struct CompareTraits<IS_LEQUAL> {
+	static char const* Name() { return "__le"; }
+	template <typename A, typename B>
+	static auto Apply(A const& a, B const& b) -> decltype(a <= b) { return a <= b; }
+};
+
+template <typename TTraits, typename A, typename B, typename = void>
+struct IsApplicable : std::false_type {};
+template <typename TTraits, typename A, typename B>
+struct IsApplicable<TTraits, A, B, std::void_t<decltype(TTraits::Apply(std::declval<A const&>(), std::declval<B const&>()))>> : std::true_type {};
+
+// An operand read from the stack. Objects of the bound type are used in
+// place; other types go through their TypeConverter.
+template <typename T, typename TOperand>
+struct Operand {
+	std::optional<TOperand> value;
+
+	bool Read(Lua::State& state, int arg) {
+		value = TypeConverter<TOperand>::Read(state, arg);
+		return value.has_value();
+	}
+	TOperand const& get() const { return *value; }
+};
+template <typename T>
+struct Operand<T, T> {
+	T const* value = nullptr;
+
+	bool Read(Lua::State& state, int arg) {
+		value = MetatableManager<T>::TestStack(state.GetState(), arg);
+		return value != nullptr;
+	}
+	T const& get() const { return *value; }
+};
+
+template <typename T, typename F>
+int PushOperatorResult(Lua::State& state, F const& apply) {
+	typedef typename std::decay<decltype(apply())>::type result_type;
+	if constexpr(std::is_same<result_type, T>::value) {
+		MetatableManager<T>::Emplace(state.GetState(), apply);
+		return 1;
+	}
+	else
+		return static_cast<int>(TypeConverter<result_type>::Push(state, apply()));
+}
+
+// Runs an operator metamethod. Exceptions are turned into Lua errors
+// once the operands have been released.
+template <typename F>
+int CallOperator(lua_State* s, char const* metamethod, F const& body) {
+	return WithState(s, [metamethod, &body](Lua::State& state) -> int {
+		int results = -1;
+		bool failed = false;
+		try {
+			results = body(state);
+		}
+		catch(std::exception& e) {
+			failed = true;
+			lua_pushfstring(state.GetState(), "C++ Exception thrown in %s.\n%s", metamethod, e.what());
+		}
+		catch(...) {
+			failed = true;
+			lua_pushfstring(state.GetState(), "Unknown C++ Exception thrown in %s.", metamethod);
+		}
+
+		if(failed)
+			return state.error();
+		if(results < 0)
+			return luaL_error(state.GetState(), "Error: Invalid operands for %s (%s and %s).", metamethod, luaL_typename(state.GetState(), 1), luaL_typename(state.GetState(), 2));
+		return results;
+	});
+}
+
+template <typename T, Operator op, typename... TOperands>
+struct ArithmeticMetamethod {
+	typedef OperatorTraits<op> traits;
+
+	static char const* Name() { return traits::Name(); }
+	static int Call(lua_State* s) {
+		return CallOperator(s, traits::Name(), [](Lua::State& state) -> int {
+			int results = -1;
+			if constexpr(traits::unary)
+				TryOperands<T, T>(state, results);
+			else if constexpr(sizeof...(TOperands) == 0)
+				TryOperands<T, T>(state, results);
+			else
+				((TryOperands<T, TOperands>(state, results) || TryOperands<TOperands, T>(state, results)) || ...);
+			return results;
+		});
+	}
+
+private:
+	template <typename A, typename B>
+	static bool TryOperands(Lua::State& state, int& results) {
+		if constexpr(!IsApplicable<traits, A, B>::value)
+			return false;
+		else {
+			Operand<T, A> a;
+			Operand<T, B> b;
+			if(!a.Read(state, 1) || !b.Read(state, 2))
+				return false;
+
+			results = PushOperatorResult<T>(state, [&a, &b]() { return traits::Apply(a.get(), b.get()); });
+			return true;
+		}
+	}
+};
+
+template <typename T, CompareOp op, typename... TOperands>
+struct ComparisonMetamethod {
+	typedef CompareTraits<op> traits;
+
+	static char const* Name() { return traits::Name(); }
+	static int Call(lua_State* s) {
+		return CallOperator(s, traits::Name(), [](Lua::State& state) -> int {
+			int results = -1;
+			if constexpr(sizeof...(TOperands) == 0)
+				TryOperands<T, T>(state, results);
+			else
+				((TryOperands<T, TOperands>(state, results) || TryOperands<TOperands, T>(state, results)) || ...);
+
+			// Values of unrelated types are never equal.
+			if(results < 0 && op == IS_EQUAL) {
+				state.pushboolean(false);
+				results = 1;
+			}
+			return results;
+		});
+	}
+
+private:
+	template <typename A, typename B>
+	static bool TryOperands(Lua::State& state, int& results) {
+		if constexpr(!IsApplicable<traits, A, B>::value)
+			return false;
+		else {
+			Operand<T, A> a;
+			Operand<T, B> b;
+			if(!a.Read(state, 1) || !b.Read(state, 2))
+				return false;
+
+			state.pushboolean(static_cast<bool>(traits::Apply(a.get(), b.get())));
+			results = 1;
+			return true;
+		}
+	}
+};
+
+template <typename T>
+struct LengthMetamethod {
+	static int Call(lua_State* s) {
+		T const* object = MetatableManager<T>::FromStack(s, 1);
+		lua_pushinteger(s, static_cast<lua_Integer>(object->size()));
+		return 1;
+	}
+};
+
+template <typename T>
+struct ToStringMetamethod {
+	static int Call(lua_State* s) {
+		T const* object = MetatableManager<T>::FromStack(s, 1);
+		return CallOperator(s, "__tostring", [object](Lua::State& state) -> int {
+			std::ostringstream stream;
+			stream << *object;
+			std::string const text = stream.str();
+			state.pushlstring(text.data(), text.size());
+			return 1;
+		});
+	}
+};
+
+template <typename T, auto F>
+struct CloseMetamethod {
+	static int Call(lua_State* s) {
+		T* object = MetatableManager<T>::FromStack(s, 1);
+		return CallOperator(s, "__close", [object](Lua::State&) -> int {
+			std::invoke(F, *object);
+			return 0;
+		});
+	}
+};
+
+}
+
+#endif
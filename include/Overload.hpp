@@ -0,0 +1,203 @@
+/*	Copyright (c) 2023 Mauro Grassia
+**	
+**	Permission is granted to use, modify and redistribute this software.
+**	Modified versions of this software MUST be marked as such.
+**	
+**	This software is provided "AS IS". In no event shall
+**	the authors or copyright holders be liable for any claim,
+**	damages or other liability. The above copyright notice
+**	and this permission notice shall be included in all copies
+**	or substantial portions of the software.
+**	
+*/
+
+#ifndef LUAPP_OVERLOAD_HPP
+#define LUAPP_OVERLOAD_HPP
+
+#include "LuaInclude.hpp"
+#include "TypeConverter.hpp"
+#include "Transform.hpp"
+#include "Value.hpp"
+
+#include <any>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*	Lua::Overload binds several functions under one name.
+ *	The first function, in declaration order, whose arity and argument
+ *	types match the call is invoked:
+ *
+ *		s.luapp_add_translated_function("foo", Lua::Overload(&foo_i, &foo_s, &foo_t));
+ *
+ *	Integer parameters only match integer values, so that f(int) and
+ *	f(double) can be told apart; floating point parameters match both.
+ */
+
+namespace Lua {
+namespace impl {
+
+// Cheap test of the value at a stack index, used to pick an overload.
+// Types without a dedicated test are tried with their TypeConverter.
+template <typename T, typename = void>
+struct ArgumentMatcher {
+	static bool Match(Lua::State& s, int id) { return TypeConverter<T>::Read(s, id).has_value(); }
+};
+template <typename T>
+struct ArgumentMatcher<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type> {
+	static bool Match(Lua::State& s, int id) { return s.isinteger(id); }
+};
+template <typename T>
+struct ArgumentMatcher<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+	static bool Match(Lua::State& s, int id) { return s.type(id) == TP_NUMBER; }
+};
+template <>
+struct ArgumentMatcher<bool> {
+	static bool Match(Lua::State& s, int id) { return s.type(id) == TP_BOOL; }
+};
+template <>
+struct ArgumentMatcher<std::string> {
+	static bool Match(Lua::State& s, int id) { return s.type(id) == TP_STRING; }
+};
+template <>
+struct ArgumentMatcher<std::string_view> {
+	static bool Match(Lua::State& s, int id) { return s.type(id) == TP_STRING; }
+};
+template <typename T>
+struct ArgumentMatcher<std::optional<T>> {
+	static bool Match(Lua::State& s, int id) { return s.isnoneornil(id) || ArgumentMatcher<T>::Match(s, id); }
+};
+template <>
+struct ArgumentMatcher<ReferenceType> {
+	static bool Match(Lua::State& s, int id) { return !s.isnone(id); }
+};
+template <>
+struct ArgumentMatcher<Ref> {
+	static bool Match(Lua::State& s, int id) { return !s.isnone(id); }
+};
+template <>
+struct ArgumentMatcher<std::any> {
+	static bool Match(Lua::State& s, int id) { return !s.isnone(id); }
+};
+template <>
+struct ArgumentMatcher<Value> {
+	static bool Match(Lua::State& s, int id) { return !s.isnone(id) && (!s.istable(id) || Value::Readable(s, id)); }
+};
+template <Lua::Type type>
+struct ArgumentMatcher<TypeCheckedReference<type>> {
+	static bool Match(Lua::State& s, int id) { return s.type(id) == type; }
+};
+template <typename T>
+struct ArgumentMatcher<std::vector<T>> {
+	static bool Match(Lua::State& s, int id) { return s.istable(id); }
+};
+template <typename T>
+struct ArgumentMatcher<std::deque<T>> {
+	static bool Match(Lua::State& s, int id) { return s.istable(id); }
+};
+template <typename T>
+struct ArgumentMatcher<std::list<T>> {
+	static bool Match(Lua::State& s, int id) { return s.istable(id); }
+};
+template <typename TKey, typename TValue>
+struct ArgumentMatcher<std::map<TKey, TValue>> {
+	static bool Match(Lua::State& s, int id) { return s.istable(id); }
+};
+
+template <typename T>
+bool MatchArgument(Lua::State& s, int& luaIndex) {
+	bool const matches = ArgumentMatcher<T>::Match(s, luaIndex);
+	luaIndex += ValueCount<T>::value;
+	return matches;
+}
+// Tuples and pairs take one argument per element.
+template <typename... T>
+struct ArgumentMatcher<std::tuple<T...>> {
+	static bool Match(Lua::State& s, int id) { return (true && ... && MatchArgument<T>(s, id)); }
+};
+template <typename T1, typename T2>
+struct ArgumentMatcher<std::pair<T1, T2>> {
+	static bool Match(Lua::State& s, int id) { return MatchArgument<T1>(s, id) && MatchArgument<T2>(s, id); }
+};
+template <>
+inline bool MatchArgument<Lua::State*>(Lua::State&, int&) {
+	return true;
+}
+
+template <typename F, typename TSignature = typename DeductFunction<F>::type>
+struct OverloadTarget;
+template <typename F, typename TFncRetVal, typename... TFncArgs>
+struct OverloadTarget<F, std::function<TFncRetVal(TFncArgs...)>> {
+	// Lua values consumed by the function; Lua::State* parameters take none.
+	static constexpr int arity = (0 + ... + (std::is_same<typename std::decay<TFncArgs>::type, Lua::State*>::value ? 0 : ValueCount<typename std::decay<TFncArgs>::type>::value));
+
+	template <int ArgOffset>
+	static bool Match(Lua::State& state, int given) {
+		if(given > arity)
+			return false;
+
+		int luaIndex = ArgOffset;
+		return (true && ... && MatchArgument<typename std::decay<TFncArgs>::type>(state, luaIndex));
+	}
+	template <int ArgOffset>
+	static int Invoke(Lua::State& state, F const& function) {
+		return InvokeTranslated<ArgOffset, TFncRetVal, TFncArgs...>(state, function);
+	}
+};
+
+inline int RaiseNoOverload(Lua::State& state, int argOffset) {
+	int const top = state.gettop();
+	state.where(1);
+	state.pushliteral("Error: No overload accepts the arguments (");
+	for(int i = argOffset; i <= top; ++i) {
+		if(i > argOffset)
+			state.pushliteral(", ");
+		state.pushstring(state.typename_aux(i));
+	}
+	state.pushliteral(").");
+	state.concat(state.gettop() - top);
+	return state.error();
+}
+
+template <typename... F>
+struct OverloadedFunction {
+	std::tuple<F...> functions;
+
+	int operator()(Lua::State& state) const {
+		// The functor userdata itself sits at index 1.
+		return Dispatch<2>(state, std::index_sequence_for<F...>());
+	}
+
+private:
+	// Expands to one match-and-call step per overload, in declaration order.
+	template <int ArgOffset, std::size_t... I>
+	int Dispatch(Lua::State& state, std::index_sequence<I...>) const {
+		int const given = state.gettop() - ArgOffset + 1;
+		int results     = 0;
+
+		bool const called
+			= ((OverloadTarget<F>::template Match<ArgOffset>(state, given) && (results = OverloadTarget<F>::template Invoke<ArgOffset>(state, std::get<I>(functions)), true))
+			   || ...);
+		if(!called)
+			return RaiseNoOverload(state, ArgOffset);
+		return results;
+	}
+};
+}
+
+template <typename... F>
+inline impl::OverloadedFunction<F...> Overload(F... functions) {
+	static_assert(sizeof...(F) > 0, "Lua::Overload needs at least one function.");
+	return { { std::move(functions)... } };
+}
+}
+
+#endif
@@ -0,0 +1,80 @@
+/*	Copyright (c) 2023 Mauro Grassia
+**	
+**	Permission is granted to use, modify and redistribute this software.
+**	Modified versions of this software MUST be marked as such.
+**	
+**	This software is provided "AS IS". In no event shall
+**	the authors or copyright holders be liable for any claim,
+**	damages or other liability. The above copyright notice
+**	and this permission notice shall be included in all copies
+**	or substantial portions of the software.
+**	
+*/
+
+#ifndef LUAPP_PROPERTYINDEX_HPP
+#define LUAPP_PROPERTYINDEX_HPP
+
+#include "LuaInclude.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+namespace Lua::impl {
+
+// Maps the property names of a bound type to their position.
+// One is built per State, in a userdata: short Lua strings are interned,
+// so such a key is found by its address through a perfect hash. Names Lua
+// does not intern are compared by content.
+class PropertyIndex {
+	struct Slot {
+		char const* key;
+		int position;
+	};
+	struct Fallback {
+		char const* key;
+		std::size_t length;
+		int position;
+	};
+
+	std::uint64_t m_multiplier;
+	unsigned m_shift;
+	unsigned m_slotCount;
+	unsigned m_fallbackCount;
+
+	Slot const* slots() const { return reinterpret_cast<Slot const*>(this + 1); }
+	Fallback const* fallbacks() const { return reinterpret_cast<Fallback const*>(slots() + m_slotCount); }
+
+	static std::size_t Hash(char const* key, std::uint64_t multiplier, unsigned shift) {
+		return static_cast<std::size_t>((static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(key)) * multiplier) >> shift);
+	}
+
+public:
+	// Pushes the index of names. The userdata keeps the key strings alive.
+	static PropertyIndex* Push(lua_State* state, std::vector<std::string_view> const& names);
+
+	// Position of the key at index arg among the names, or -1.
+	int Find(lua_State* state, int arg) const {
+		if(lua_type(state, arg) != LUA_TSTRING)
+			return -1;
+
+		std::size_t length = 0;
+		char const* key    = lua_tolstring(state, arg, &length);
+
+		Slot const& slot = slots()[Hash(key, m_multiplier, m_shift)];
+		if(slot.key == key)
+			return slot.position;
+
+		for(unsigned i = 0; i < m_fallbackCount; ++i) {
+			Fallback const& fallback = fallbacks()[i];
+			if(fallback.length == length && std::memcmp(fallback.key, key, length) == 0)
+				return fallback.position;
+		}
+		return -1;
+	}
+};
+
+}
+
+#endif
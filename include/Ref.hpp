@@ -0,0 +1,106 @@
+/*	Copyright (c) 2023 Mauro Grassia
+**	
+**	Permission is granted to use, modify and redistribute this software.
+**	Modified versions of this software MUST be marked as such.
+**	
+**	This software is provided "AS IS". In no event shall
+**	the authors or copyright holders be liable for any claim,
+**	damages or other liability. The above copyright notice
+**	and this permission notice shall be included in all copies
+**	or substantial portions of the software.
+**	
+*/
+
+#ifndef LUAPP_REF_HPP
+#define LUAPP_REF_HPP
+
+#include "LuaInclude.hpp"
+#include "FwdDecl.hpp"
+#include <atomic>
+#include <cstdint>
+
+namespace Lua {
+
+namespace impl {
+// References dropped on any thread, released later by the thread that owns
+// the State. A lock-free stack that its owner empties all at once.
+struct ReleaseQueue {
+	struct Node;
+	std::atomic<Node*> head { nullptr };
+
+	bool empty() const noexcept { return !head.load(std::memory_order_relaxed); }
+};
+
+// Every open State owns a slot in a process-wide table. Closing the State
+// bumps the generation of its slot, which invalidates the Refs into it.
+// The slot also records the thread that owns the State: the one that
+// opened it, until another one claims it.
+std::uint32_t AcquireStateSlot(lua_State* state, std::uint32_t& generation, ReleaseQueue*& releases);
+void ReleaseStateSlot(std::uint32_t slot) noexcept;
+void ClaimStateSlot(std::uint32_t slot) noexcept;
+// The main thread of the State in the slot, or nullptr if it was closed.
+lua_State* FindStateSlot(std::uint32_t slot, std::uint32_t generation) noexcept;
+// The same, but nullptr as well unless the calling thread owns the State.
+lua_State* FindOwnedStateSlot(std::uint32_t slot, std::uint32_t generation) noexcept;
+
+// Releases table[key]. The owning thread releases it at once. Other threads
+// queue registry keys, and leave the keys of other tables alone, since a
+// stack index or upvalue means nothing later. Does nothing once the State
+// is closed.
+void ReleaseReference(std::uint32_t slot, std::uint32_t generation, int table, int key) noexcept;
+// Releases everything queued so far. Only on the thread that owns the State.
+void ApplyReleases(lua_State* state, ReleaseQueue& releases, std::uint32_t generation) noexcept;
+}
+
+// A registry reference held by value: copying it references the value
+// again, destroying it releases the reference. Unlike ReferenceType it is
+// not shared through the heap, and a Ref that outlives its State is simply
+// invalid.
+//
+// Copying a Ref calls into the State, so it is only allowed on the thread
+// that owns the State (see State::luapp_claim_thread); on any other thread
+// it throws Lua::lua_exception. A copy of a Ref whose State is closed is
+// empty. Moving and destroying a Ref are safe on
+// any thread. The owning thread releases the key at once, after a few
+// atomic loads. Other threads queue it, which also costs an allocation and
+// a CAS.
+class Ref {
+	friend class State;
+
+	std::uint32_t m_slot       = 0;
+	std::uint32_t m_generation = 0;
+	int m_key                  = LUA_NOREF;
+
+	Ref(std::uint32_t slot, std::uint32_t generation, int key) noexcept
+		: m_slot(slot),
+		  m_generation(generation),
+		  m_key(key) {}
+
+public:
+	Ref() noexcept = default;
+	Ref(Ref const& o);
+	Ref(Ref&& o) noexcept
+		: m_slot(o.m_slot),
+		  m_generation(o.m_generation),
+		  m_key(o.m_key) {
+		o.m_key = LUA_NOREF;
+	}
+	Ref& operator=(Ref const& o);
+	Ref& operator=(Ref&& o) noexcept;
+	~Ref() { reset(); }
+
+	// Releases the reference; the Ref becomes empty. Released on another
+	// thread, the registry entry is freed the next time the owning thread
+	// calls into the State.
+	void reset() noexcept;
+
+	// True while the State is open and the value is not nil.
+	explicit operator bool() const noexcept;
+	int key() const noexcept { return m_key; }
+	// The main thread of the State, or nullptr once it is closed.
+	lua_State* state() const noexcept;
+};
+
+}
+
+#endif
@@ -31,6 +31,9 @@ public:
 	Reference(Reference&&);
 	Reference& operator=(Reference&&);
 
+	// Safe on any thread. The thread that owns the State releases the key
+	// at once. Other threads queue registry keys for it, see
+	// State::luapp_drain_releases, and leave the keys of other tables.
 	void destroy();
 	explicit operator bool() const noexcept;
 	std::weak_ptr<Lua::State> state() const noexcept;
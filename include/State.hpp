@@ -13,13 +13,20 @@
 
 #ifndef LUAPP_STATE_HPP
 #define LUAPP_STATE_HPP
+#include <cstdint>
 #include <memory>
 #include <optional>
+#include <functional>
+#include <initializer_list>
+#include <new>
+#include <type_traits>
+#include <vector>
 
 #include "LuaInclude.hpp"
 #include "FwdDecl.hpp"
 #include "Enums.hpp"
 #include "Reference.hpp"
+#include "Ref.hpp"
 #include "MetatableManager.hpp"
 
 // Documentation tag
@@ -27,14 +34,62 @@
 
 namespace Lua {
 
+namespace impl {
+// Callables other than std::function, which are stored inline by concrete type.
+template <typename F>
+using EnableIfTranslated = typename std::enable_if<
+	std::is_invocable_r<int, typename std::decay<F>::type&, Lua::State&>::value
+	&& !std::is_same<typename std::decay<F>::type, std::function<int(Lua::State&)>>::value>::type;
+}
+
+// An entry of State::luapp_register_library.
+class LibraryFunction {
+	char const* m_name;
+	std::function<int(Lua::State&)> m_function;
+	lua_CFunction m_cfunction;
+
+public:
+	LibraryFunction(char const* name, lua_CFunction function)
+		: m_name(name),
+		  m_cfunction(function) {}
+	LibraryFunction(char const* name, std::function<int(Lua::State&)> function)
+		: m_name(name),
+		  m_function(std::move(function)),
+		  m_cfunction(nullptr) {}
+	template <typename F, typename = impl::EnableIfTranslated<F>>
+	LibraryFunction(char const* name, F function)
+		: m_name(name),
+		  m_function(std::move(function)),
+		  m_cfunction(nullptr) {}
+
+	char const* name() const noexcept { return m_name; }
+	std::function<int(Lua::State&)> const& function() const noexcept { return m_function; }
+	lua_CFunction cfunction() const noexcept { return m_cfunction; }
+};
+
 class State {
 	friend class StateManager;
+	template <typename>
+	friend class impl::MetatableManager;
 	lua_State* m_state;
+	State* m_owner;
 	std::weak_ptr<State> m_self;
+	std::uint32_t m_slot;       // See Lua::Ref
+	std::uint32_t m_generation;
+	impl::ReleaseQueue* m_releases; // References dropped on other threads
+	std::vector<void const*> m_metatables; // Of the bound types, by type id
+	std::vector<std::unique_ptr<impl::ObjectPoolBase>> m_pools; // Of the pooled types, by type id
 
 	State(State const&)            = delete;
 	State& operator=(State const&) = delete;
 
+	// Non-owning view over a coroutine thread of another State.
+	// It holds no resources, so it is safe to unwind it with lua_error.
+	State(lua_State* thread, State& owner);
+	void bindExtraSpace() noexcept;
+	State* owner() noexcept { return m_owner ? m_owner : this; }
+	State const* owner() const noexcept { return m_owner ? m_owner : this; }
+
 protected:
 	State();
 
@@ -50,6 +105,29 @@ public:
 	bool operator!() const noexcept;
 	lua_State* GetState() const noexcept;
 
+	// Returns the State that owns the given lua_State in O(1).
+	// Coroutines inherit the pointer from their main thread.
+	static State* FromLuaState(lua_State* state) noexcept { return *static_cast<State**>(lua_getextraspace(state)); }
+
+	// Calls function(State&) with a State bound to the given lua_State,
+	// which may be the main thread or a coroutine spawned from it.
+	template <typename F>
+	static int WithState(lua_State* s, F&& function) {
+		State* state = FromLuaState(s);
+		if(!state)
+			return 0;
+		if(state->m_releases && !state->m_releases->empty())
+			state->luapp_drain_releases();
+		if(state->m_state == s)
+			return function(*state);
+
+		// function may leave with lua_error, which must not skip a destructor,
+		// so the view lives in raw storage and is never destroyed. It owns
+		// nothing, so there is nothing to release.
+		alignas(State) unsigned char thread[sizeof(State)];
+		return function(*new(thread) State(s, *state));
+	}
+
 	bool IsValidIndex(int);
 	bool IsAcceptableIndex(int);
 
@@ -64,13 +142,35 @@ public:
     tagged(0,1,e)					void luapp_push_reference(ReferenceType);
     tagged(0,0,-)					void luapp_destroy_reference(ReferenceType);
     tagged(0,0,-)					void luapp_destroy_reference(Reference*);
+    // Whether the reference was made by this State or by one of its coroutines.
+    tagged(0,0,-)					bool luapp_owns_reference(Reference const&) const noexcept;
+    // Lightweight references, see Ref.hpp.
+    tagged(1,0,e)					Ref luapp_pop_ref();
+    tagged(0,0,e)					Ref luapp_read_ref(int index);
+    tagged(0,1,-)					void luapp_push_ref(Ref const& ref);
+    // Releases the references that other threads dropped since the last call.
+    // Also done on every call into the State from Lua and when references are created.
+    tagged(0,0,-)					void luapp_drain_releases();
+    // Makes the calling thread the owner of the State, which only it may use
+    // from then on. A State is owned by the thread that opened it.
+    tagged(0,0,-)					void luapp_claim_thread();
 
     // Required for most users. Might need luapp_register_metatables.
     tagged(0,0,-)					template <typename T> void luapp_register_object(bool allowConstructor=true) { impl::MetatableManager<T>::Register(GetState(), allowConstructor); }
-    tagged(0,1,-)                   int luapp_push_translated_function(std::function<int(Lua::State&)> const& function);
-    tagged(0,0,-)            inline void luapp_add_translated_function(char const* name, std::function<int(Lua::State&)> const& function) { luapp_push_translated_function(function); setglobal(name); }
+    tagged(0,1,-)                   int luapp_push_translated_function(std::function<int(Lua::State&)> function);
+    tagged(0,0,-)            inline void luapp_add_translated_function(char const* name, std::function<int(Lua::State&)> function) { luapp_push_translated_function(std::move(function)); setglobal(name); }
+    tagged(0,1,-)                   template <typename F, typename = impl::EnableIfTranslated<F>> int luapp_push_translated_function(F&& function) { return impl::Functor::Push(GetState(), std::forward<F>(function)); }
+    tagged(0,0,-)                   template <typename F, typename = impl::EnableIfTranslated<F>> void luapp_add_translated_function(char const* name, F&& function) { luapp_push_translated_function(std::forward<F>(function)); setglobal(name); }
+    tagged(0,1,-)                   int luapp_push_translated_function(lua_CFunction function);
+    tagged(0,0,-)            inline void luapp_add_translated_function(char const* name, lua_CFunction function) { luapp_push_translated_function(function); setglobal(name); }
+    tagged(0,0,-)                   void luapp_register_library(char const* name, std::initializer_list<LibraryFunction> functions);
     tagged(0,1,-)                   template <typename T, typename ... Args> typename Lua::GenericDecay<T>::type* luapp_push_object(Args&& ... args) { return impl::MetatableManager<T>::Construct(GetState(),std::forward<Args>(args)...); }
     tagged(0,1,-)					template <typename T> typename Lua::GenericDecay<T>::type* luapp_move_object(T&& arg) { return impl::MetatableManager<T>::Construct(GetState(),std::move(arg)); }
+    tagged(0,0,-)					template <typename T> void luapp_register_object_lazy(bool allowConstructor=true) { impl::MetatableManager<T>::RegisterLazy(GetState(), allowConstructor); }
+    tagged(0,1,-)                   template <typename T> T* luapp_push_borrowed(T* object) { return impl::MetatableManager<T>::PushBorrowed(GetState(),object); }
+    tagged(0,1,-)                   template <typename T> T* luapp_push_shared(std::shared_ptr<T> object) { return impl::MetatableManager<T>::PushShared(GetState(),std::move(object)); }
+    tagged(0,0,-)                   template <typename T> std::shared_ptr<T> luapp_get_shared(int arg) { return impl::MetatableManager<T>::SharedFromStack(GetState(),arg); }
+    tagged(0,0,-)                   void luapp_invalidate_view(void const* container);
     tagged(0,0,0)                   template <typename T> T* luapp_get_object(int arg) { return impl::MetatableManager<T>::FromStack(GetState(),arg); }
     tagged(0,0,e)                   template <typename T> T& luapp_require_object(int arg) { T* ptr = impl::MetatableManager<T>::FromStack(GetState(),arg); if(!ptr) luaL_error(GetState(),"C++ / Lua Error: Stack item %d is not of type %s!",arg,impl::MetatableDescriptorImpl<T>::name()); return *ptr; }
     tagged(0,0,0)					template <typename T> std::optional<T> luapp_get_value(int id) { return Lua::TypeConverter<typename GenericDecay<T>::type>::Read(*this, id); }
@@ -99,6 +199,13 @@ public:
 		return valuePusher<Args...>::push(this, std::forward<Args>(args)...);
 	}
 
+	// Batched calls, defined in Function.hpp. They call a function once per argument set,
+	// reusing one stack frame and error handler, and write each result to out.
+	// Input elements are std::tuple argument packs or single arguments.
+	tagged(0,0,e)					template <typename TResult, typename TInputIt, typename TOutputIt> TOutputIt luapp_call_batch(ReferenceType const& function, TInputIt first, TInputIt last, TOutputIt out);
+	// The i-th call receives columns[i]... as its arguments.
+	tagged(0,0,e)					template <typename TResult, typename TOutputIt, typename... TColumns> TOutputIt luapp_call_batch_columns(ReferenceType const& function, std::size_t count, TOutputIt out, TColumns const& ... columns);
+
 	tagged(0,0,-)					int absindex(int);
 	tagged(2|1,1,e)					void arith(Operator);
 	tagged(0,0,-)					lua_CFunction atpanic(lua_CFunction);
@@ -240,6 +347,13 @@ public:
 
 	// clang-format on
 };
+
+namespace impl {
+template <typename F>
+int WithState(lua_State* s, F&& function) {
+	return Lua::State::WithState(s, std::forward<F>(function));
+}
+}
 }
 
 #endif
@@ -0,0 +1,222 @@
+/*	Copyright (c) 2023 Mauro Grassia
+**	
+**	Permission is granted to use, modify and redistribute this software.
+**	Modified versions of this software MUST be marked as such.
+**	
+**	This software is provided "AS IS". In no event shall
+**	the authors or copyright holders be liable for any claim,
+**	damages or other liability. The above copyright notice
+**	and this permission notice shall be included in all copies
+**	or substantial portions of the software.
+**	
+*/
+
+#ifndef LUAPP_TABLEVIEW_HPP
+#define LUAPP_TABLEVIEW_HPP
+
+#include "LuaInclude.hpp"
+#include "State.hpp"
+#include "TypeConverter.hpp"
+#include "Utils.hpp"
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+/*	A table argument read in place, without converting it:
+ *
+ *		static int configure(Lua::TableView config) {
+ *			int width = config.get<int>("width").value_or(640);
+ *			config.forEachElement<std::string>([](lua_Integer i, std::string name) { ... });
+ *			config.forEach<std::string, double>([](std::string key, double value) { ... });
+ *			...
+ *		}
+ *
+ *	Lookups are raw and only touch the requested keys. Iteration pushes one
+ *	entry at a time and restores the stack afterwards, even when the callback
+ *	throws. A TableView refers to a stack slot, so it is only valid while the
+ *	function it was passed to is running.
+ *
+ *	The nested table returned by get<TableView>(key) stays on the stack, one
+ *	slot per call, until the function returns. Every push first makes room
+ *	with checkstack, so looping over many nested tables grows the stack
+ *	rather than overflowing it; such a loop may restore the top itself once
+ *	it is done with each view. Lua::lua_exception is thrown when the stack
+ *	cannot grow.
+ */
+
+namespace Lua {
+
+class TableView {
+	Lua::State* m_state;
+	int m_index;
+
+	// Restores the stack top on scope exit.
+	class StackGuard {
+		Lua::State& m_state;
+		int m_top;
+
+	public:
+		explicit StackGuard(Lua::State& state)
+			: m_state(state),
+			  m_top(state.gettop()) {}
+		~StackGuard() { m_state.settop(m_top); }
+		StackGuard(StackGuard const&)            = delete;
+		StackGuard& operator=(StackGuard const&) = delete;
+	};
+
+	// Makes room for slots more values on the stack.
+	void Reserve(int slots) const {
+		if(!m_state->checkstack(slots))
+			throw lua_exception("Lua::TableView: Stack overflow.");
+	}
+	// Reads the value on top of the stack and pops it. Tables read as a
+	// TableView stay on the stack so that the view remains valid.
+	template <typename T>
+	std::optional<T> ReadTop() const {
+		if constexpr(std::is_same<T, TableView>::value) {
+			if(m_state->istable(-1))
+				return TableView(*m_state, -1);
+			m_state->pop(1);
+			return std::nullopt;
+		}
+		else {
+			std::optional<T> value = TypeConverter<T>::Read(*m_state, m_state->absindex(-1));
+			m_state->pop(1);
+			return value;
+		}
+	}
+	// Pushes t[key]. Returns false, pushing nothing, if the key does not convert.
+	template <typename TKey>
+	bool PushKey(TKey const& key) const {
+		Reserve(1);
+		if constexpr(std::is_integral<TKey>::value && !std::is_same<TKey, bool>::value) {
+			m_state->rawgeti(m_index, static_cast<lua_Integer>(key));
+			return true;
+		}
+		else {
+			if constexpr(std::is_convertible<TKey const&, char const*>::value)
+				m_state->pushstring(key);
+			else if(TypeConverter<TKey>::Push(*m_state, key) != 1)
+				return false;
+			m_state->rawget(m_index);
+			return true;
+		}
+	}
+	// Calls f and reports whether the iteration should go on; f may
+	// return false to stop it.
+	template <typename F, typename... Args>
+	static bool Visit(F& f, Args&&... args) {
+		if constexpr(std::is_same<decltype(f(std::forward<Args>(args)...)), bool>::value)
+			return f(std::forward<Args>(args)...);
+		else {
+			f(std::forward<Args>(args)...);
+			return true;
+		}
+	}
+
+public:
+	// An empty view, only meant to be assigned to.
+	TableView()
+		: m_state(nullptr),
+		  m_index(0) {}
+	TableView(Lua::State& state, int index)
+		: m_state(&state),
+		  m_index(state.absindex(index)) {}
+
+	Lua::State& state() const { return *m_state; }
+	int index() const { return m_index; }
+
+	// Length of the array part, as with the # operator without __len.
+	std::size_t size() const { return static_cast<std::size_t>(m_state->rawlen(m_index)); }
+
+	// t[key], or nullopt if it is nil or does not convert to T.
+	template <typename T, typename TKey>
+	std::optional<T> get(TKey const& key) const {
+		if(!PushKey(key))
+			return std::nullopt;
+		return ReadTop<T>();
+	}
+	template <typename TKey>
+	bool contains(TKey const& key) const {
+		if(!PushKey(key))
+			return false;
+		bool const found = !m_state->isnil(-1);
+		m_state->pop(1);
+		return found;
+	}
+
+	// Calls f(Lua::State&, keyIndex, valueIndex) for every entry, in the
+	// order of lua_next. The entry must not be removed from the stack, and
+	// the key must not be converted in place, e.g. with lua_tolstring.
+	template <typename F>
+	void forEachEntry(F&& f) const {
+		// The key and the value, and a copy of the key for forEach.
+		Reserve(3);
+		StackGuard guard(*m_state);
+		m_state->pushnil();
+		while(m_state->next(m_index)) {
+			int const top = m_state->gettop();
+			if(!Visit(f, *m_state, top - 1, top))
+				return;
+			m_state->settop(top - 1);
+		}
+	}
+	// Calls f(TKey, TValue) for the entries whose key and value convert;
+	// the others are skipped.
+	template <typename TKey, typename TValue, typename F>
+	void forEach(F&& f) const {
+		forEachEntry([&f](Lua::State& s, int keyIndex, int valueIndex) -> bool {
+			// The key is read from a copy, popped with the entry, in case
+			// its converter changes it in place.
+			s.pushvalue(keyIndex);
+			std::optional<TKey> key = TypeConverter<TKey>::Read(s, s.absindex(-1));
+			if(!key)
+				return true;
+			std::optional<TValue> value = TypeConverter<TValue>::Read(s, valueIndex);
+			if(!value)
+				return true;
+			return Visit(f, std::move(*key), std::move(*value));
+		});
+	}
+	// Calls f(i, T) for t[1] .. t[#t], in order. Returns false if an element
+	// does not convert to T, which also stops the iteration.
+	template <typename T, typename F>
+	bool forEachElement(F&& f) const {
+		Reserve(1);
+		StackGuard guard(*m_state);
+		std::size_t const count = size();
+		for(std::size_t i = 1; i <= count; ++i) {
+			m_state->rawgeti(m_index, static_cast<lua_Integer>(i));
+			std::optional<T> value = TypeConverter<T>::Read(*m_state, m_state->absindex(-1));
+			if(!value)
+				return false;
+			if(!Visit(f, static_cast<lua_Integer>(i), std::move(*value)))
+				return true;
+			m_state->pop(1);
+		}
+		return true;
+	}
+};
+
+template <>
+struct TypeConverter<TableView> {
+	typedef std::optional<TableView> Arg;
+	static Arg Read(Lua::State& s, int id) {
+		if(!s.istable(id))
+			return std::nullopt;
+		return TableView(s, id);
+	}
+	static std::size_t Push(Lua::State& s, TableView const& v) {
+		s.pushvalue(v.index());
+		return 1;
+	}
+	static std::string Name() { return "table"; }
+	static char const* TypeName() { return "table"; }
+};
+
+}
+
+#endif
@@ -23,6 +23,7 @@
 #include <tuple>
 #include <type_traits>
 #include <optional>
+#include <utility>
 
 namespace Lua {
 namespace impl {
@@ -42,38 +43,60 @@ void AssignOrSwap(T& oldReference, T&& newRReference) {
 	else // if constexpr(std::is_copy_assignable<T>::value)
 		oldReference = newRReference;
 }
+enum InvokeError { IE_NONE, IE_BAD_ARGUMENT, IE_TOO_MANY_ARGUMENTS, IE_EXCEPTION };
+
+// Why a translated call failed. Nothing is formatted until the Lua error is raised.
+struct InvokeStatus {
+	InvokeError error    = IE_NONE;
+	int index            = 0;
+	int count            = 0;
+	char const* expected = nullptr;
+};
+
+// Name used in argument errors; converters without TypeName() get a generic one.
+template <typename T, typename = void>
+struct ArgumentTypeName {
+	static char const* get() { return "value"; }
+};
+template <typename T>
+struct ArgumentTypeName<T, std::void_t<decltype(TypeConverter<T>::TypeName())>> {
+	static char const* get() { return TypeConverter<T>::TypeName(); }
+};
+
 template <typename T>
 struct LuaArgumentReader {
-	static std::size_t Read(Lua::State& state, int luaIndex, T& destination) {
+	static bool Read(Lua::State& state, int& luaIndex, T& destination, InvokeStatus& status) {
 		std::optional<T> retVal = TypeConverter<T>::Read(state, luaIndex);
 
 		if(!retVal) {
-			throw lua_exception(
-				std::string("Error: Function argument #") + std::to_string(luaIndex) + " should be of type "
-				+ TypeConverter<typename std::remove_cv<typename std::remove_pointer<T>::type>::type>::Name() + ", got " + state.typename_aux(luaIndex) + " instead."
-			);
+			status.error    = IE_BAD_ARGUMENT;
+			status.index    = luaIndex;
+			status.expected = ArgumentTypeName<T>::get();
+			return false;
 		}
 
 		AssignOrSwap(destination, std::move(*retVal));
-		return 1;
+		luaIndex += ValueCount<T>::value;
+		return true;
 	}
 };
 template <typename T>
 struct LuaArgumentReader<std::optional<T>> {
-	static std::size_t Read(Lua::State& state, int luaIndex, std::optional<T>& destination) {
+	static bool Read(Lua::State& state, int& luaIndex, std::optional<T>& destination, InvokeStatus&) {
 		std::optional<T> retVal = TypeConverter<T>::Read(state, luaIndex);
 
 		using std::swap;
 		swap(destination, retVal);
 
-		return 1;
+		luaIndex += ValueCount<T>::value;
+		return true;
 	}
 };
 template <>
 struct LuaArgumentReader<Lua::State*> {
-	static std::size_t Read(Lua::State& state, int, Lua::State*& destination) {
+	static bool Read(Lua::State& state, int&, Lua::State*& destination, InvokeStatus&) {
 		destination = &state;
-		return 0;
+		return true;
 	}
 };
 
@@ -81,45 +104,94 @@ template <std::size_t N, typename T>
 struct TupleArgumentReader;
 template <typename... Args>
 struct TupleArgumentReader<0, std::tuple<Args...>> {
-	static std::size_t Read(Lua::State&, int lastIndex, std::tuple<Args...>&) { return lastIndex; }
+	static bool Read(Lua::State&, int&, std::tuple<Args...>&, InvokeStatus&) { return true; }
 };
 template <std::size_t N, typename... Args>
 struct TupleArgumentReader<N, std::tuple<Args...>> {
-	static std::size_t Read(Lua::State& state, int luaIndex, std::tuple<Args...>& args) {
-		std::size_t argsRead
-			= LuaArgumentReader<typename std::decay<decltype(std::get<sizeof...(Args) - N>(args))>::type>::Read(state, luaIndex, std::get<sizeof...(Args) - N>(args));
-		return TupleArgumentReader<N - 1, std::tuple<Args...>>::Read(state, luaIndex + static_cast<int>(argsRead), args);
+	static bool Read(Lua::State& state, int& luaIndex, std::tuple<Args...>& args, InvokeStatus& status) {
+		if(!LuaArgumentReader<typename std::decay<decltype(std::get<sizeof...(Args) - N>(args))>::type>::Read(state, luaIndex, std::get<sizeof...(Args) - N>(args), status))
+			return false;
+		return TupleArgumentReader<N - 1, std::tuple<Args...>>::Read(state, luaIndex, args, status);
+	}
+};
+// Tuples and pairs take one argument per element, and errors name the
+// element that did not convert.
+template <typename... T>
+struct LuaArgumentReader<std::tuple<T...>> {
+	static bool Read(Lua::State& state, int& luaIndex, std::tuple<T...>& destination, InvokeStatus& status) {
+		return TupleArgumentReader<sizeof...(T), std::tuple<T...>>::Read(state, luaIndex, destination, status);
+	}
+};
+template <typename T1, typename T2>
+struct LuaArgumentReader<std::pair<T1, T2>> {
+	static bool Read(Lua::State& state, int& luaIndex, std::pair<T1, T2>& destination, InvokeStatus& status) {
+		std::tuple<T1, T2> values;
+		if(!TupleArgumentReader<2, std::tuple<T1, T2>>::Read(state, luaIndex, values, status))
+			return false;
+		destination = std::pair<T1, T2>(std::move(std::get<0>(values)), std::move(std::get<1>(values)));
+		return true;
 	}
 };
 
-template <typename TFncRetVal, typename... TFncArgs>
-std::function<int(Lua::State&)> Transform(std::function<TFncRetVal(TFncArgs...)> function) {
-	return [function](Lua::State& state) -> int {
-		try {
-			typedef std::tuple<typename std::decay<TFncArgs>::type...> functionArguments;
-			functionArguments arguments;
-
-			if constexpr(!std::is_same<functionArguments, std::tuple<>>::value) {
-				int const argPadding = 2;
-
-				std::size_t const argsRead = TupleArgumentReader<sizeof...(TFncArgs), functionArguments>::Read(state, argPadding, arguments) - 3;
-				int const argsGiven        = state.gettop() - 2;
-				if(argsGiven > static_cast<int>(argsRead))
-					throw lua_exception(std::string("Too many arguments provided. Read: ") + std::to_string(argsRead) + ", Given: " + std::to_string(argsGiven));
+// Raises the Lua error described by status. Never returns.
+inline int RaiseInvokeError(Lua::State& state, InvokeStatus const& status, int argOffset) {
+	switch(status.error) {
+	case IE_BAD_ARGUMENT:
+		return luaL_error(
+			state.GetState(), "Error: Function argument #%d should be of type %s, got %s instead.", status.index - argOffset + 1, status.expected,
+			state.typename_aux(status.index)
+		);
+	case IE_TOO_MANY_ARGUMENTS:
+		return luaL_error(state.GetState(), "Too many arguments provided. Read: %d, Given: %d", status.index - argOffset, status.count);
+	default:
+		// The message has already been pushed.
+		return state.error();
+	}
+}
+
+// Reads the arguments of a function starting at stack index ArgOffset,
+// calls the function and pushes its return value.
+// Argument errors are reported without throwing; the arguments are
+// destroyed before the Lua error unwinds the stack.
+template <int ArgOffset, typename TFncRetVal, typename... TFncArgs, typename F>
+int InvokeTranslated(Lua::State& state, F const& function) {
+	typedef std::tuple<typename std::decay<TFncArgs>::type...> functionArguments;
+
+	InvokeStatus status;
+	int results = 0;
+	{
+		functionArguments arguments;
+
+		if constexpr(!std::is_same<functionArguments, std::tuple<>>::value) {
+			status.index = ArgOffset;
+			if(TupleArgumentReader<sizeof...(TFncArgs), functionArguments>::Read(state, status.index, arguments, status)) {
+				status.count = state.gettop() - ArgOffset + 1;
+				if(status.count > status.index - ArgOffset)
+					status.error = IE_TOO_MANY_ARGUMENTS;
 			}
+		}
 
-			if constexpr(std::is_void<TFncRetVal>::value) {
-				std::apply(function, arguments);
-				return 0;
+		if(status.error == IE_NONE) {
+			try {
+				if constexpr(std::is_void<TFncRetVal>::value)
+					std::apply(function, arguments);
+				else
+					results = static_cast<int>(TypeConverter<TFncRetVal>::Push(state, std::apply(function, arguments)));
 			}
-			else {
-				return static_cast<int>(TypeConverter<TFncRetVal>::Push(state, std::apply(function, arguments)));
+			catch(std::exception& e) {
+				status.error = IE_EXCEPTION;
+				state.pushfstring("C++ Exception Thrown.\n%s", e.what());
+			}
+			catch(...) {
+				status.error = IE_EXCEPTION;
+				state.pushliteral("Unknown C++ Exception thrown.");
 			}
 		}
-		catch(std::exception& e) {
-			return state.error("C++ Exception Thrown.\n%s", e.what());
-		}
-	};
+	}
+
+	if(status.error != IE_NONE)
+		return RaiseInvokeError(state, status, ArgOffset);
+	return results;
 }
 
 template <typename T>
@@ -140,6 +212,18 @@ template <typename C, typename RT, typename... Args>
 struct DeductFunction<RT (C::*)(Args...)> {
 	using type = std::function<RT(C*, Args...)>;
 };
+template <typename RT, typename... Args>
+struct DeductFunction<RT (*)(Args...) noexcept> {
+	using type = std::function<RT(Args...)>;
+};
+template <typename C, typename RT, typename... Args>
+struct DeductFunction<RT (C::*)(Args...) const noexcept> {
+	using type = std::function<RT(C const*, Args...)>;
+};
+template <typename C, typename RT, typename... Args>
+struct DeductFunction<RT (C::*)(Args...) noexcept> {
+	using type = std::function<RT(C*, Args...)>;
+};
 template <typename T>
 struct DeductFunction<std::function<T>> {
 	using type = std::function<T>;
@@ -150,18 +234,65 @@ template <typename F>
 auto deductFunction(F f) -> typename DeductFunction<F>::type {
 	return { f };
 }
+
+// A function known at compile time, exposed as a plain lua_CFunction.
+// The std::function type only carries the signature; none is ever built.
+template <auto F, typename TSignature = typename DeductFunction<decltype(F)>::type>
+struct StaticFunction;
+template <auto F, typename TFncRetVal, typename... TFncArgs>
+struct StaticFunction<F, std::function<TFncRetVal(TFncArgs...)>> {
+	static int Call(lua_State* s) {
+		return Lua::State::WithState(s, [](Lua::State& state) -> int {
+			return InvokeTranslated<1, TFncRetVal, TFncArgs...>(state, F);
+		});
+	}
+};
+
+// A callable of concrete type F, translated to a Lua functor.
+// It is stored inline in the functor userdata, with no std::function.
+template <typename F, typename TSignature = typename DeductFunction<F>::type>
+struct TranslatedFunction;
+template <typename F, typename TFncRetVal, typename... TFncArgs>
+struct TranslatedFunction<F, std::function<TFncRetVal(TFncArgs...)>> {
+	F function;
+
+	int operator()(Lua::State& state) const {
+		// The functor userdata itself sits at index 1.
+		return InvokeTranslated<2, TFncRetVal, TFncArgs...>(state, function);
+	}
+};
+
+template <typename TFncRetVal, typename... TFncArgs>
+std::function<int(Lua::State&)> Transform(std::function<TFncRetVal(TFncArgs...)> function) {
+	return TranslatedFunction<std::function<TFncRetVal(TFncArgs...)>> { std::move(function) };
+}
+}
+
+// Transform<&function>() and Bind<&Class::method>() bind at compile time.
+// The result can be used wherever a lua_CFunction is accepted, including
+// luapp_add_translated_function and member_function_storage.
+template <auto F>
+constexpr lua_CFunction Transform() {
+	return &impl::StaticFunction<F>::Call;
+}
+
+template <auto F>
+constexpr lua_CFunction Bind() {
+	static_assert(std::is_member_function_pointer<decltype(F)>::value, "Lua::Bind expects a member function pointer.");
+	return &impl::StaticFunction<F>::Call;
 }
 
 template <typename T>
-inline std::function<int(Lua::State&)> Transform(T fnc) {
-	return impl::Transform(impl::deductFunction<T>(fnc));
+inline impl::TranslatedFunction<T> Transform(T fnc) {
+	return { std::move(fnc) };
 }
 
 template <typename TClass, typename TRetVal, typename... TArgs>
-inline std::function<int(Lua::State&)> Transform(TRetVal (TClass::*fptr)(TArgs...), TClass* instance) {
-	return impl::Transform(std::function<TRetVal(TArgs...)>([fptr, instance](TArgs... args) -> TRetVal {
+inline auto Transform(TRetVal (TClass::*fptr)(TArgs...), TClass* instance) {
+	auto bound = [fptr, instance](TArgs... args) -> TRetVal {
 		return ((*instance).*fptr)(std::forward<TArgs>(args)...);
-	}));
+	};
+	return impl::TranslatedFunction<decltype(bound), std::function<TRetVal(TArgs...)>> { std::move(bound) };
 }
 }
 
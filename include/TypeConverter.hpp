@@ -18,16 +18,58 @@
 #include "State.hpp"
 #include "StateManager.hpp"
 
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <deque>
 #include <list>
 #include <map>
 #include <any>
+#include <array>
+#include <set>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+
+#if __has_include(<version>)
+#	include <version>
+#endif
+#ifdef __cpp_lib_span
+#	include <span>
+#endif
 
 namespace Lua {
 namespace impl {
+constexpr std::size_t NumberBufferSize = 64;
+
+// Formats the number at id as Lua does ("%.14g", with ".0" appended to
+// floats that look like integers), without converting the stack slot.
+inline std::size_t FormatNumber(Lua::State& s, int id, char (&buffer)[NumberBufferSize]) {
+	if(s.isinteger(id))
+		return static_cast<std::size_t>(std::to_chars(buffer, buffer + NumberBufferSize, s.tointeger(id)).ptr - buffer);
+
+#ifdef __cpp_lib_to_chars
+	std::size_t length = static_cast<std::size_t>(std::to_chars(buffer, buffer + NumberBufferSize, s.tonumber(id), std::chars_format::general, 14).ptr - buffer);
+#else
+	int const written  = std::snprintf(buffer, NumberBufferSize, "%.14g", static_cast<double>(s.tonumber(id)));
+	std::size_t length = written > 0 ? static_cast<std::size_t>(written) : 0;
+#endif
+	bool looksInteger = true;
+	for(std::size_t i = 0; i < length && looksInteger; ++i)
+		looksInteger = buffer[i] == '-' || (buffer[i] >= '0' && buffer[i] <= '9');
+	if(looksInteger && length + 2 <= NumberBufferSize) {
+		buffer[length++] = '.';
+		buffer[length++] = '0';
+	}
+	return length;
+}
+
 template <typename T>
 struct IntegerConverter {
 	typedef typename std::enable_if<std::is_integral<T>::value, std::optional<T>>::type Arg;
@@ -53,6 +95,7 @@ struct IntegerConverter {
 		return 1;
 	}
 	static std::string Name() { return "integer"; }
+	static char const* TypeName() { return "integer"; }
 };
 template <typename T>
 struct NumberConverter {
@@ -79,6 +122,7 @@ struct NumberConverter {
 		return 1;
 	}
 	static std::string Name() { return "number"; }
+	static char const* TypeName() { return "number"; }
 };
 }
 
@@ -89,15 +133,19 @@ struct TypeConverter {
 	typedef std::optional<T> Arg;
 
 	static Arg Read(Lua::State& s, int id) {
-		T p = reinterpret_cast<T>(s.checkudata(id, metatable::name()));
+		T p = reinterpret_cast<T>(Lua::impl::MetatableManager<typename std::remove_cv<typename std::remove_pointer<T>::type>::type>::TestStack(s.GetState(), id));
 		if(!p)
 			return std::nullopt;
 
 		return p;
 	}
 	static std::string Name() { return metatable::name(); }
-	static std::size_t Push(Lua::State& s, T&& v) {
-		if(v)
+	static char const* TypeName() { return metatable::name(); }
+	// Pointers are pushed as borrowed objects, owned by C++.
+	static std::size_t Push(Lua::State& s, T v) {
+		if constexpr(std::is_pointer<T>::value)
+			s.luapp_push_borrowed<typename std::remove_cv<typename std::remove_pointer<T>::type>::type>(const_cast<typename std::remove_cv<typename std::remove_pointer<T>::type>::type*>(v));
+		else if(v)
 			s.luapp_move_object<T>(std::move(v));
 		else
 			s.pushnil();
@@ -105,6 +153,25 @@ struct TypeConverter {
 	}
 };
 
+template <typename T>
+struct TypeConverter<std::shared_ptr<T>> {
+	typedef Lua::impl::MetatableDescriptorImpl<typename std::remove_cv<T>::type> metatable;
+	typedef std::optional<std::shared_ptr<T>> Arg;
+
+	static Arg Read(Lua::State& s, int id) {
+		std::shared_ptr<T> p = s.luapp_get_shared<typename std::remove_cv<T>::type>(id);
+		if(!p)
+			return std::nullopt;
+		return p;
+	}
+	static std::string Name() { return metatable::name(); }
+	static char const* TypeName() { return metatable::name(); }
+	static std::size_t Push(Lua::State& s, std::shared_ptr<T> const& v) {
+		s.luapp_push_shared<typename std::remove_cv<T>::type>(std::const_pointer_cast<typename std::remove_cv<T>::type>(v));
+		return 1;
+	}
+};
+
 // void
 template <>
 struct TypeConverter<void> {};
@@ -132,6 +199,23 @@ struct TypeConverter<ReferenceType> {
 		return 1;
 	}
 	static std::string Name() { return "reference"; }
+	static char const* TypeName() { return "reference"; }
+};
+
+template <>
+struct TypeConverter<Ref> {
+	typedef std::optional<Ref> Arg;
+	static Arg Read(Lua::State& s, int id) {
+		if(s.isnone(id))
+			return std::nullopt;
+		return s.luapp_read_ref(id);
+	}
+	static std::size_t Push(Lua::State& s, Ref const& reference) {
+		s.luapp_push_ref(reference);
+		return 1;
+	}
+	static std::string Name() { return "reference"; }
+	static char const* TypeName() { return "reference"; }
 };
 
 template <Lua::Type type>
@@ -190,6 +274,30 @@ struct TypeConverter<TypeCheckedReference<type>> {
 
 		return strType + " reference";
 	}
+	static char const* TypeName() {
+		switch(type) {
+		case TP_NIL:
+			return "nil reference";
+		case TP_BOOL:
+			return "bool reference";
+		case TP_LIGHTUSERDATA:
+			return "lightuserdata reference";
+		case TP_NUMBER:
+			return "number reference";
+		case TP_STRING:
+			return "string reference";
+		case TP_TABLE:
+			return "table reference";
+		case TP_FUNCTION:
+			return "function reference";
+		case TP_USERDATA:
+			return "userdata reference";
+		case TP_THREAD:
+			return "thread reference";
+		default:
+			return "reference";
+		}
+	}
 };
 
 // std::string
@@ -197,28 +305,99 @@ template <>
 struct TypeConverter<std::string> {
 	typedef std::optional<std::string> Arg;
 	static Arg Read(Lua::State& s, int id) {
-		if(!s.isstring(id)) {
-			if(s.isnumber(id))
-				return std::to_string(s.tonumber(id));
-			else if(s.isinteger(id))
-				return std::to_string(s.tointeger(id));
-			else if(s.isboolean(id))
-				return s.toboolean(id) ? "true" : "false";
+		switch(s.type(id)) {
+		case TP_STRING: {
+			size_t size     = 0;
+			char const* str = s.tolstring(id, &size);
+			if(!str)
+				return std::nullopt;
+			return std::string(str, size);
+		}
+		case TP_NUMBER: {
+			char buffer[impl::NumberBufferSize];
+			return std::string(buffer, impl::FormatNumber(s, id, buffer));
+		}
+		case TP_BOOL:
+			return s.toboolean(id) ? "true" : "false";
+		default:
 			return std::nullopt;
 		}
+	}
+	static std::size_t Push(Lua::State& s, std::string const& v) {
+		s.pushlstring(v.c_str(), v.size());
+		return 1;
+	}
+	static std::string Name() { return "string"; }
+	static char const* TypeName() { return "string"; }
+};
+
+// std::string_view points into the Lua string, so it stays valid as long
+// as the value is on the stack, such as for the duration of a bound call.
+// Only strings are read: converting a number would replace it in place.
+template <>
+struct TypeConverter<std::string_view> {
+	typedef std::optional<std::string_view> Arg;
+	static Arg Read(Lua::State& s, int id) {
+		if(s.type(id) != TP_STRING)
+			return std::nullopt;
 
 		size_t size     = 0;
 		char const* str = s.tolstring(id, &size);
 		if(!str)
 			return std::nullopt;
-		return std::string(str, size);
+		return std::string_view(str, size);
 	}
-	static std::size_t Push(Lua::State& s, std::string const& v) {
-		s.pushlstring(v.c_str(), v.size());
+	static std::size_t Push(Lua::State& s, std::string_view v) {
+		s.pushlstring(v.data(), v.size());
+		return 1;
+	}
+	static std::string Name() { return "string"; }
+	static char const* TypeName() { return "string"; }
+};
+
+#ifdef __cpp_lib_span
+// Byte views of Lua strings, with the lifetime of std::string_view.
+template <>
+struct TypeConverter<std::span<std::byte const>> {
+	typedef std::optional<std::span<std::byte const>> Arg;
+	static Arg Read(Lua::State& s, int id) {
+		if(s.type(id) != TP_STRING)
+			return std::nullopt;
+
+		size_t size     = 0;
+		char const* str = s.tolstring(id, &size);
+		if(!str)
+			return std::nullopt;
+		return std::span<std::byte const>(reinterpret_cast<std::byte const*>(str), size);
+	}
+	static std::size_t Push(Lua::State& s, std::span<std::byte const> v) {
+		s.pushlstring(reinterpret_cast<char const*>(v.data()), v.size());
+		return 1;
+	}
+	static std::string Name() { return "string"; }
+	static char const* TypeName() { return "string"; }
+};
+template <>
+struct TypeConverter<std::span<char const>> {
+	typedef std::optional<std::span<char const>> Arg;
+	static Arg Read(Lua::State& s, int id) {
+		if(s.type(id) != TP_STRING)
+			return std::nullopt;
+
+		size_t size     = 0;
+		char const* str = s.tolstring(id, &size);
+		if(!str)
+			return std::nullopt;
+		return std::span<char const>(str, size);
+	}
+	static std::size_t Push(Lua::State& s, std::span<char const> v) {
+		s.pushlstring(v.data(), v.size());
 		return 1;
 	}
 	static std::string Name() { return "string"; }
+	static char const* TypeName() { return "string"; }
 };
+#endif
 
 template <>
 struct TypeConverter<bool> {
@@ -229,12 +408,14 @@ struct TypeConverter<bool> {
 		return 1;
 	}
 	static std::string Name() { return "boolean"; }
+	static char const* TypeName() { return "boolean"; }
 };
 
 template <typename T>
 struct TypeConverter<std::optional<T>> {
 	typedef std::optional<T> Arg;
 	static Arg Read(Lua::State& s, int id) { return TypeConverter<T>::Read(s, id); }
+	static char const* TypeName() { return TypeConverter<T>::TypeName(); }
 	static std::size_t Push(Lua::State& s, Arg const& v) {
 		if(v)
 			return TypeConverter<T>::Push(s, *v);
@@ -260,6 +441,124 @@ template <> struct TypeConverter<double> : public impl::NumberConverter<double>{
 template <> struct TypeConverter<long double> : public impl::NumberConverter<long double>{};
 // clang-format on
 
+namespace impl {
+// Tables are created with their final size and filled with rawseti and
+// rawset, so that building them never runs metamethods.
+
+// Pushes value as a single stack slot. Returns false if nothing was pushed.
+template <typename T>
+bool PushSlot(Lua::State& s, T const& value, int top) {
+	std::size_t const pushedValues = TypeConverter<T>::Push(s, value);
+	if(pushedValues > 1) {
+		s.settop(top);
+		throw lua_exception("Lua::Table Push: A value is taking multiple spots in the stack.");
+	}
+	return pushedValues == 1;
+}
+// Sets t[i] = value on the table on top of the stack.
+template <typename T>
+void PushElement(Lua::State& s, lua_Integer i, T const& value, int top) {
+	if(PushSlot<T>(s, value, top))
+		s.rawseti(-2, i);
+}
+
+template <typename TContainer>
+std::size_t PushSequence(Lua::State& s, TContainer const& v) {
+	int const top = s.gettop();
+
+	s.createtable(static_cast<int>(v.size()), 0);
+	lua_Integer i = 0;
+	for(auto it = v.begin(); it != v.end(); ++it)
+		PushElement<typename TContainer::value_type>(s, ++i, *it, top);
+	return 1;
+}
+
+template <typename TMap>
+std::size_t PushMap(Lua::State& s, TMap const& v) {
+	int const top = s.gettop();
+
+	s.createtable(0, static_cast<int>(v.size()));
+	for(auto it = v.begin(); it != v.end(); ++it) {
+		if(!PushSlot<typename TMap::key_type>(s, it->first, top))
+			continue;
+		if(!PushSlot<typename TMap::mapped_type>(s, it->second, top)) {
+			s.pop(1);
+			continue;
+		}
+		s.rawset(-3);
+	}
+	return 1;
+}
+
+// Reads every element of the array part; nullopt if one does not convert.
+template <typename TContainer, typename F>
+std::optional<TContainer> ReadSequence(Lua::State& s, int id, F const& add) {
+	if(!s.istable(id))
+		return std::nullopt;
+
+	id                           = s.absindex(id);
+	lua_Unsigned const itemCount = s.rawlen(id);
+
+	TContainer v;
+	for(lua_Unsigned i = 0; i < itemCount; ++i) {
+		s.rawgeti(id, static_cast<lua_Integer>(i + 1));
+		std::optional<typename TContainer::value_type> argt = TypeConverter<typename TContainer::value_type>::Read(s, s.absindex(-1));
+		s.pop(1);
+		if(!argt)
+			return std::nullopt;
+		add(v, std::move(*argt));
+	}
+	return v;
+}
+
+// Entries whose key or value does not convert are skipped.
+template <typename TMap>
+TMap ReadMap(Lua::State& s, int id) {
+	s.pushvalue(id);
+	s.pushnil();
+
+	TMap m;
+	while(s.next(-2)) {
+		s.pushvalue(-2);
+
+		std::optional<typename TMap::key_type> key = TypeConverter<typename TMap::key_type>::Read(s, s.absindex(-1));
+		if(key) {
+			std::optional<typename TMap::mapped_type> value = TypeConverter<typename TMap::mapped_type>::Read(s, s.absindex(-2));
+			if(value)
+				m.emplace(std::move(*key), std::move(*value));
+		}
+		s.pop(2);
+	}
+	s.pop(1);
+
+	return m;
+}
+
+// Stack slots taken by a value: tuples and pairs are multiple values,
+// as in the results of Lua::LuaFunction.
+template <typename T>
+struct ValueCount : std::integral_constant<int, 1> {};
+template <typename... T>
+struct ValueCount<std::tuple<T...>> : std::integral_constant<int, (0 + ... + ValueCount<T>::value)> {};
+template <typename T1, typename T2>
+struct ValueCount<std::pair<T1, T2>> : std::integral_constant<int, ValueCount<T1>::value + ValueCount<T2>::value> {};
+
+template <std::size_t I, typename TTuple>
+bool ReadTupleElement(Lua::State& s, int& index, TTuple& values) {
+	typedef typename std::tuple_element<I, TTuple>::type::value_type element_type;
+
+	std::get<I>(values) = TypeConverter<element_type>::Read(s, index);
+	index += ValueCount<element_type>::value;
+	return std::get<I>(values).has_value();
+}
+// Reads the values from index on into a tuple of optionals; stops at the
+// first failure.
+template <typename TTuple, std::size_t... I>
+bool ReadTuple(Lua::State& s, int index, TTuple& values, std::index_sequence<I...>) {
+	return (ReadTupleElement<I>(s, index, values) && ...);
+}
+}
+
 template <typename T>
 struct TypeConverter<std::vector<T>> {
 	typedef std::optional<std::vector<T>> Arg;
@@ -285,25 +584,9 @@ struct TypeConverter<std::vector<T>> {
 		}
 		return std::move(v);
 	}
-	static std::size_t Push(lua_State* s, std::vector<T> const& v) {
-		int const top = s.gettop();
-
-		s.createtable(v.size(), 0);
-		for(std::size_t i = 0; i < v.size(); ++i) {
-			size_t const pushedValues = TypeConverter<T>::Push(s, v[i]);
-
-			if(!pushedValues)
-				continue;
-			else if(pushedValues > 1) {
-				s.settop(top);
-				throw lua_exception("Lua::Array Push: An argument is taking multiple spots in the stack.");
-			}
-
-			s.rawseti(-2, i + 1);
-		}
-		return 1;
-	}
+	static std::size_t Push(Lua::State& s, std::vector<T> const& v) { return impl::PushSequence(s, v); }
 	static std::string Name() { return TypeConverter<T>::Name() + " vector"; }
+	static char const* TypeName() { return "table"; }
 };
 
 template <typename T>
@@ -316,7 +599,6 @@ struct TypeConverter<std::deque<T>> {
 		lua_Unsigned itemCount = s.rawlen(id);
 
 		std::deque<T> v;
-		v.reserve(itemCount);
 
 		for(lua_Unsigned i = 0; i < itemCount; ++i) {
 			s.rawgeti(id, i + 1);
@@ -331,25 +613,9 @@ struct TypeConverter<std::deque<T>> {
 		}
 		return std::move(v);
 	}
-	static std::size_t Push(Lua::State& s, std::deque<T> const& v) {
-		int const top = s.gettop();
-
-		s.createtable(v.size(), 0);
-		for(std::size_t i = 0; i < v.size(); ++i) {
-			size_t const pushedValues = TypeConverter<T>::Push(s, v[i]);
-
-			if(!pushedValues)
-				continue;
-			else if(pushedValues > 1) {
-				s.settop(top);
-				throw lua_exception("Lua::Array Push: An argument is taking multiple spots in the stack.");
-			}
-
-			s.rawseti(-2, i + 1);
-		}
-		return 1;
-	}
+	static std::size_t Push(Lua::State& s, std::deque<T> const& v) { return impl::PushSequence(s, v); }
 	static std::string Name() { return TypeConverter<T>::Name() + " deque"; }
+	static char const* TypeName() { return "table"; }
 };
 
 template <typename T>
@@ -377,25 +643,82 @@ struct TypeConverter<std::list<T>> {
 		}
 		return std::move(v);
 	}
-	static std::size_t Push(Lua::State& s, std::list<T> const& v) {
-		int const top = s.gettop();
+	static std::size_t Push(Lua::State& s, std::list<T> const& v) { return impl::PushSequence(s, v); }
+	static std::string Name() { return TypeConverter<T>::Name() + " list"; }
+	static char const* TypeName() { return "table"; }
+};
 
-		s.createtable(v.size(), 0);
-		for(std::size_t i = 0; i < v.size(); ++i) {
-			size_t const pushedValues = TypeConverter<T>::Push(s, v[i]);
+// Sets are sequences of their elements, in iteration order.
+template <typename T>
+struct TypeConverter<std::set<T>> {
+	typedef std::optional<std::set<T>> Arg;
+	static Arg Read(Lua::State& s, int id) {
+		return impl::ReadSequence<std::set<T>>(s, id, [](std::set<T>& v, T&& value) { v.insert(std::move(value)); });
+	}
+	static std::size_t Push(Lua::State& s, std::set<T> const& v) { return impl::PushSequence(s, v); }
+	static std::string Name() { return TypeConverter<T>::Name() + " set"; }
+	static char const* TypeName() { return "table"; }
+};
 
-			if(!pushedValues)
-				continue;
-			else if(pushedValues > 1) {
-				s.settop(top);
-				throw lua_exception("Lua::Array Push: An argument is taking multiple spots in the stack.");
-			}
+// The table must hold exactly N elements.
+template <typename T, std::size_t N>
+struct TypeConverter<std::array<T, N>> {
+	typedef std::optional<std::array<T, N>> Arg;
+	static Arg Read(Lua::State& s, int id) {
+		if(!s.istable(id) || s.rawlen(id) != N)
+			return std::nullopt;
 
-			s.rawseti(-2, i + 1);
+		id = s.absindex(id);
+		std::array<T, N> v {};
+		for(std::size_t i = 0; i < N; ++i) {
+			s.rawgeti(id, static_cast<lua_Integer>(i + 1));
+			std::optional<T> value = TypeConverter<T>::Read(s, s.absindex(-1));
+			s.pop(1);
+			if(!value)
+				return std::nullopt;
+			v[i] = std::move(*value);
 		}
-		return 1;
+		return v;
 	}
-	static std::string Name() { return TypeConverter<T>::Name() + " list"; }
+	static std::size_t Push(Lua::State& s, std::array<T, N> const& v) { return impl::PushSequence(s, v); }
+	static std::string Name() { return TypeConverter<T>::Name() + " array"; }
+	static char const* TypeName() { return "table"; }
+};
+
+// Tuples and pairs are multiple values, one per element, as in function
+// arguments and results. They cannot be stored in a table.
+template <typename... T>
+struct TypeConverter<std::tuple<T...>> {
+	typedef std::optional<std::tuple<T...>> Arg;
+	// Reads the values at id and after it.
+	static Arg Read(Lua::State& s, int id) {
+		std::tuple<std::optional<T>...> values;
+		if(!impl::ReadTuple(s, s.absindex(id), values, std::index_sequence_for<T...>()))
+			return std::nullopt;
+		return std::apply([](std::optional<T>&... value) { return std::tuple<T...>(std::move(*value)...); }, values);
+	}
+	static std::size_t Push(Lua::State& s, std::tuple<T...> const& v) {
+		return std::apply([&s](T const&... value) { return (std::size_t(0) + ... + TypeConverter<T>::Push(s, value)); }, v);
+	}
+	static std::string Name() { return "tuple"; }
+	static char const* TypeName() { return "values"; }
+};
+
+template <typename T1, typename T2>
+struct TypeConverter<std::pair<T1, T2>> {
+	typedef std::optional<std::pair<T1, T2>> Arg;
+	static Arg Read(Lua::State& s, int id) {
+		std::optional<std::tuple<T1, T2>> values = TypeConverter<std::tuple<T1, T2>>::Read(s, id);
+		if(!values)
+			return std::nullopt;
+		return std::pair<T1, T2>(std::move(std::get<0>(*values)), std::move(std::get<1>(*values)));
+	}
+	static std::size_t Push(Lua::State& s, std::pair<T1, T2> const& v) {
+		std::size_t const first = TypeConverter<T1>::Push(s, v.first);
+		return first + TypeConverter<T2>::Push(s, v.second);
+	}
+	static std::string Name() { return TypeConverter<T1>::Name() + ", " + TypeConverter<T2>::Name() + " pair"; }
+	static char const* TypeName() { return "values"; }
 };
 
 template <typename TKey, typename TValue>
@@ -405,50 +728,130 @@ struct TypeConverter<std::map<TKey, TValue>> {
 	static Arg Read(Lua::State& s, int id) {
 		if(!s.istable(id))
 			return std::nullopt;
+		return impl::ReadMap<std::map<TKey, TValue>>(s, id);
+	}
+	static size_t Push(Lua::State& s, std::map<TKey, TValue> const& v) { return impl::PushMap(s, v); }
+	static std::string Name() { return TypeConverter<TKey>::Name() + "->" + TypeConverter<TValue>::Name() + " table"; }
+	static char const* TypeName() { return "table"; }
+};
 
-		s.pushvalue(id);
-		s.pushnil();
+template <typename TKey, typename TValue>
+struct TypeConverter<std::unordered_map<TKey, TValue>> {
+	typedef std::optional<std::unordered_map<TKey, TValue>> Arg;
 
-		std::map<TKey, TValue> m;
-		while(s.next(-2)) {
-			s.pushvalue(-2);
+	static Arg Read(Lua::State& s, int id) {
+		if(!s.istable(id))
+			return std::nullopt;
+		return impl::ReadMap<std::unordered_map<TKey, TValue>>(s, id);
+	}
+	static size_t Push(Lua::State& s, std::unordered_map<TKey, TValue> const& v) { return impl::PushMap(s, v); }
+	static std::string Name() { return TypeConverter<TKey>::Name() + "->" + TypeConverter<TValue>::Name() + " table"; }
+	static char const* TypeName() { return "table"; }
+};
 
-			std::optional<TKey> key = TypeConverter<TKey>::Read(s, s.absindex(-1));
-			if(!key)
-				continue;
-			std::optional<TValue> value = TypeConverter<TValue>::Read(s, s.absindex(-2));
-			if(!value)
-				continue;
-			m.emplace(std::make_pair(std::move(*key), std::move(*value)));
-			s.pop(2);
-		}
-		s.pop(1);
+// A data member of T listed by StructConverter<T>.
+template <typename T, typename TMember>
+struct FieldBinding {
+	char const* name;
+	TMember T::*member;
+};
+template <typename T, typename TMember>
+constexpr FieldBinding<T, TMember> Field(char const* name, TMember T::*member) {
+	return { name, member };
+}
 
-		return std::move(m);
-	}
-	static size_t Push(Lua::State& s, std::map<TKey, TValue> const& v) {
-		s.createtable(0, v.size());
+/*	Plain structs converted to and from tables with one field per member:
+ *
+ *		template <> struct Lua::TypeConverter<Player> : Lua::StructConverter<Player> {
+ *			static constexpr auto fields() { return std::make_tuple(Lua::Field("name", &Player::name), Lua::Field("hp", &Player::hp)); }
+ *		};
+ *
+ *	The field names are pushed once per State and kept in the registry, so a
+ *	conversion is a fixed sequence of raw accesses with no key hashing.
+ *	Reading requires every field to convert.
+ */
+template <typename T>
+struct StructConverter {
+	typedef std::optional<T> Arg;
 
-		int const top = s.gettop();
-		for(auto it = v.begin(); it != v.end(); ++it) {
-			size_t const keyPushedValues = TypeConverter<TKey>::Push(s, it->first);
-			if(!keyPushedValues || keyPushedValues > 1) {
-				s.settop(top);
-				continue;
-			}
+	static Arg Read(Lua::State& s, int id) {
+		if(!s.istable(id))
+			return std::nullopt;
 
-			size_t const valPushedValues = TypeConverter<TValue>::Push(s, it->second);
-			if(!valPushedValues || valPushedValues > 1) {
-				s.settop(top);
-				continue;
-			}
+		id = s.absindex(id);
+		PushKeys(s);
+		int const keys = s.gettop();
 
-			s.settable(-3);
-		}
+		T object {};
+		bool const read = ReadFields(s, id, keys, object, std::make_index_sequence<FieldCount()>());
+		s.pop(1);
+		if(!read)
+			return std::nullopt;
+		return object;
+	}
+	static std::size_t Push(Lua::State& s, T const& v) {
+		PushKeys(s);
+		int const keys = s.gettop();
 
+		s.createtable(0, static_cast<int>(FieldCount()));
+		PushFields(s, keys, v, std::make_index_sequence<FieldCount()>());
+		s.remove(keys);
 		return 1;
 	}
-	static std::string Name() { return TypeConverter<TKey>::Name() + "->" + TypeConverter<TValue>::name() + " table"; }
+	static std::string Name() { return "table"; }
+	static char const* TypeName() { return "table"; }
+
+private:
+	static constexpr std::size_t FieldCount() { return std::tuple_size<decltype(TypeConverter<T>::fields())>::value; }
+	static char const* KeysKey() {
+		static char const key = 0;
+		return &key;
+	}
+	// Pushes the table of field names of T in this State.
+	static void PushKeys(Lua::State& s) {
+		if(s.rawgetp(LUA_REGISTRYINDEX, KeysKey()) == LUA_TTABLE)
+			return;
+		s.pop(1);
+
+		s.createtable(static_cast<int>(FieldCount()), 0);
+		PushNames(s, std::make_index_sequence<FieldCount()>());
+		s.pushvalue(-1);
+		s.rawsetp(LUA_REGISTRYINDEX, KeysKey());
+	}
+	template <std::size_t... I>
+	static void PushNames(Lua::State& s, std::index_sequence<I...>) {
+		auto const fields = TypeConverter<T>::fields();
+		((s.pushstring(std::get<I>(fields).name), s.rawseti(-2, static_cast<lua_Integer>(I + 1))), ...);
+	}
+	template <std::size_t... I>
+	static bool ReadFields(Lua::State& s, int table, int keys, T& object, std::index_sequence<I...>) {
+		auto const fields = TypeConverter<T>::fields();
+		return (ReadField(s, table, keys, static_cast<lua_Integer>(I + 1), object, std::get<I>(fields)) && ...);
+	}
+	template <std::size_t... I>
+	static void PushFields(Lua::State& s, int keys, T const& object, std::index_sequence<I...>) {
+		auto const fields = TypeConverter<T>::fields();
+		(PushField(s, keys, static_cast<lua_Integer>(I + 1), object, std::get<I>(fields)), ...);
+	}
+	template <typename TMember>
+	static bool ReadField(Lua::State& s, int table, int keys, lua_Integer i, T& object, FieldBinding<T, TMember> const& field) {
+		s.rawgeti(keys, i);
+		s.rawget(table);
+		std::optional<TMember> value = TypeConverter<TMember>::Read(s, s.absindex(-1));
+		s.pop(1);
+		if(!value)
+			return false;
+		object.*field.member = std::move(*value);
+		return true;
+	}
+	template <typename TMember>
+	static void PushField(Lua::State& s, int keys, lua_Integer i, T const& object, FieldBinding<T, TMember> const& field) {
+		s.rawgeti(keys, i);
+		if(impl::PushSlot<TMember>(s, object.*field.member, keys - 1))
+			s.rawset(-3);
+		else
+			s.pop(1);
+	}
 };
 
 template <>
@@ -503,6 +906,7 @@ public:
 	}
 
 	static std::string Name() { return "std::any"; }
+	static char const* TypeName() { return "any"; }
 };
 }
 
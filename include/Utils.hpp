@@ -15,6 +15,7 @@
 #define LUAPP_UTILS_H
 
 #include "LuaInclude.hpp"
+#include <cstddef>
 #include <exception>
 #include <string>
 #include <cmath>
@@ -100,6 +101,79 @@ struct TupleDecay<T&&> {
 };
 
 namespace impl {
+// Returns the userdata at arg if its metatable is the one stored in the
+// registry under key. This costs a pointer-keyed lookup and a compare,
+// where luaL_testudata would look the metatable up by name.
+inline void* TestUdata(lua_State* state, int arg, void const* key) {
+	void* p = lua_touserdata(state, arg);
+	if(!p || !lua_getmetatable(state, arg))
+		return nullptr;
+	lua_rawgetp(state, LUA_REGISTRYINDEX, key);
+	bool const matches = lua_rawequal(state, -1, -2);
+	lua_pop(state, 2);
+	return matches ? p : nullptr;
+}
+inline void* CheckUdata(lua_State* state, int arg, void const* key, char const* name) {
+	void* p = TestUdata(state, arg, key);
+	if(!p)
+		luaL_typeerror(state, arg, name);
+	return p;
+}
+// Same, against the metatable at the given pseudo-index, usually an
+// upvalue of the calling closure: a single pointer compare.
+inline void* TestUdataAt(lua_State* state, int arg, int metatable) {
+	void* p = lua_touserdata(state, arg);
+	if(!p || !lua_getmetatable(state, arg))
+		return nullptr;
+	bool const matches = lua_rawequal(state, -1, metatable);
+	lua_pop(state, 1);
+	return matches ? p : nullptr;
+}
+inline void* CheckUdataAt(lua_State* state, int arg, int metatable, char const* name) {
+	void* p = TestUdataAt(state, arg, metatable);
+	if(!p)
+		luaL_typeerror(state, arg, name);
+	return p;
+}
+
+// A small index for every bound type, used by per-State caches.
+std::size_t NextTypeId() noexcept;
+
+// Runs body, which returns a number of results. If it throws, the message
+// is pushed after the position, as luaL_error would, and -1 is returned.
+// The caller raises it with lua_error once the exception is gone: a Lua
+// error must not unwind a catch block. With an action, the message tells
+// that it was thrown while doing it to an object of the named type.
+template <typename F>
+int CatchExceptions(lua_State* state, F const& body, char const* action = nullptr, char const* type = nullptr) {
+	try {
+		return body();
+	}
+	catch(lua_exception& e) {
+		luaL_where(state, 1);
+		if(action)
+			lua_pushfstring(state, "C++ / Lua Exception thrown while %s object %s.\n%s", action, type, e.what());
+		else
+			lua_pushfstring(state, "C++ / Lua Exception: %s", e.what());
+	}
+	catch(std::exception& e) {
+		luaL_where(state, 1);
+		if(action)
+			lua_pushfstring(state, "C++ Exception thrown while %s object %s.\n%s", action, type, e.what());
+		else
+			lua_pushfstring(state, "C++ Exception: %s", e.what());
+	}
+	catch(...) {
+		luaL_where(state, 1);
+		if(action)
+			lua_pushfstring(state, "Unknown C++ Exception thrown while %s object %s.", action, type);
+		else
+			lua_pushliteral(state, "Unknown C++ Exception thrown.");
+	}
+	lua_concat(state, 2);
+	return -1;
+}
+
 template <typename...>
 struct VerifyVarArgs;
 template <>
@@ -0,0 +1,244 @@
+/*	Copyright (c) 2023 Mauro Grassia
+**	
+**	Permission is granted to use, modify and redistribute this software.
+**	Modified versions of this software MUST be marked as such.
+**	
+**	This software is provided "AS IS". In no event shall
+**	the authors or copyright holders be liable for any claim,
+**	damages or other liability. The above copyright notice
+**	and this permission notice shall be included in all copies
+**	or substantial portions of the software.
+**	
+*/
+
+#ifndef LUAPP_VALUE_HPP
+#define LUAPP_VALUE_HPP
+
+#include "LuaInclude.hpp"
+#include "Enums.hpp"
+#include "Reference.hpp"
+#include "State.hpp"
+#include "TypeConverter.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+/*	Lua::Value holds any Lua value, read as a tree of plain C++ values:
+ *
+ *		static void configure(Lua::Value config) {
+ *			if(Lua::Value const* width = config.find("width"))
+ *				if(lua_Integer const* w = width->get_if<lua_Integer>())
+ *					...
+ *		}
+ *
+ *	It replaces the std::any conversion for dynamic payloads. Strings of up
+ *	to 15 bytes are stored inline and each table keeps its entries in a
+ *	single vector, indexed by an open addressing hash once it has more than
+ *	a few keys. Tables that contain themselves, or that are nested deeper
+ *	than the limit, do not convert. Functions, userdata and threads are kept
+ *	as references.
+ */
+
+namespace Lua {
+
+class Value;
+
+// A string stored inline up to InlineCapacity bytes, on the heap beyond.
+class SmallString {
+public:
+	static constexpr std::size_t InlineCapacity = 15;
+
+	SmallString() noexcept
+		: m_size(0) {
+		m_inline[0] = '\0';
+	}
+	SmallString(char const* data, std::size_t size);
+	explicit SmallString(std::string_view text)
+		: SmallString(text.data(), text.size()) {}
+	SmallString(SmallString const& o)
+		: SmallString(o.data(), o.size()) {}
+	SmallString(SmallString&& o) noexcept;
+	SmallString& operator=(SmallString const& o);
+	SmallString& operator=(SmallString&& o) noexcept;
+	~SmallString();
+
+	char const* data() const noexcept { return isInline() ? m_inline : m_heap; }
+	std::size_t size() const noexcept { return m_size; }
+	std::string_view view() const noexcept { return { data(), m_size }; }
+	std::string str() const { return std::string(data(), m_size); }
+
+	bool operator==(SmallString const& o) const noexcept { return view() == o.view(); }
+	bool operator!=(SmallString const& o) const noexcept { return view() != o.view(); }
+
+private:
+	bool isInline() const noexcept { return m_size <= InlineCapacity; }
+
+	std::size_t m_size;
+	union {
+		char m_inline[InlineCapacity + 1];
+		char* m_heap;
+	};
+};
+
+// A function, userdata or thread, kept alive by a reference. Values are
+// the same when they have the same address, as given by lua_topointer when
+// they were read; the collector never moves them. Without an address, only
+// copies of the same reference are the same.
+struct ValueReference {
+	ReferenceType reference;
+	Lua::Type type;
+	void const* address = nullptr;
+
+	bool operator==(ValueReference const& o) const noexcept {
+		if(address || o.address)
+			return type == o.type && address == o.address;
+		return reference == o.reference;
+	}
+	bool operator!=(ValueReference const& o) const noexcept { return !(*this == o); }
+};
+
+// A table as one vector: the array part t[1] .. t[n], followed by the
+// keys and values of the other entries, interleaved. Beyond LinearLimit
+// keys, these are found through an open addressing index with linear
+// probing, kept at most half full.
+//
+// Table keys compare by content, as a Value copies the tables it reads:
+// t[{1}] and t[{1}] are the same entry.
+class ValueTable {
+public:
+	static constexpr std::size_t LinearLimit = 8;
+
+	std::size_t arraySize() const noexcept { return m_arraySize; }
+	std::size_t hashSize() const noexcept;
+
+	// t[i + 1] for i < arraySize().
+	Value const& element(std::size_t i) const;
+	// The other entries, for i < hashSize().
+	Value const& key(std::size_t i) const;
+	Value const& value(std::size_t i) const;
+
+	// Returns nullptr when the key is missing.
+	Value const* find(Value const& key) const;
+	Value const* find(std::string_view key) const;
+	Value const* find(char const* key) const { return find(std::string_view(key)); }
+	Value const* find(lua_Integer key) const;
+
+	void reserve(std::size_t arraySize, std::size_t hashSize);
+	// t[#t + 1] = value
+	void append(Value value);
+	// t[key] = value. Assigning nil does not remove the entry.
+	void set(Value key, Value value);
+	// Adds an entry whose key is known not to be present.
+	void add(Value key, Value value);
+
+	// The same entries; the order of the keys outside the array part does
+	// not matter.
+	bool operator==(ValueTable const& o) const;
+	bool operator!=(ValueTable const& o) const { return !(*this == o); }
+
+private:
+	template <typename TEqual>
+	std::size_t probe(std::size_t hash, TEqual const& equal) const;
+	std::size_t findHash(Value const& key) const;
+	void index(std::size_t entry);
+	void rehash(std::size_t capacity);
+
+	std::vector<Value> m_values;
+	std::vector<std::uint32_t> m_index; // Entry + 1 by slot, 0 when free; empty up to LinearLimit keys
+	std::size_t m_arraySize = 0;
+};
+
+class Value {
+public:
+	typedef std::variant<std::monostate, bool, lua_Integer, lua_Number, SmallString, ValueTable, ValueReference> storage_type;
+
+	static constexpr std::size_t DefaultMaxDepth = 32;
+
+	Value() noexcept = default;
+	Value(bool v)
+		: m_value(v) {}
+	template <typename T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, int>::type = 0>
+	Value(T v)
+		: m_value(static_cast<lua_Integer>(v)) {}
+	template <typename T, typename std::enable_if<std::is_floating_point<T>::value, int>::type = 0>
+	Value(T v)
+		: m_value(static_cast<lua_Number>(v)) {}
+	Value(char const* v)
+		: m_value(SmallString(std::string_view(v))) {}
+	Value(std::string_view v)
+		: m_value(SmallString(v)) {}
+	Value(std::string const& v)
+		: m_value(SmallString(v.data(), v.size())) {}
+	Value(SmallString v)
+		: m_value(std::move(v)) {}
+	Value(ValueTable v)
+		: m_value(std::move(v)) {}
+	Value(ValueReference v)
+		: m_value(std::move(v)) {}
+
+	// The value at index, or nullopt for a table holding itself or nested
+	// more than maxDepth levels deep.
+	static std::optional<Value> Read(Lua::State& state, int index, std::size_t maxDepth = DefaultMaxDepth);
+	// Whether Read would succeed, checked without converting anything.
+	static bool Readable(Lua::State& state, int index, std::size_t maxDepth = DefaultMaxDepth);
+	void push(Lua::State& state) const;
+
+	Lua::Type type() const noexcept;
+	bool isNil() const noexcept { return std::holds_alternative<std::monostate>(m_value); }
+
+	template <typename T>
+	T const* get_if() const noexcept { return std::get_if<T>(&m_value); }
+	template <typename T>
+	T* get_if() noexcept { return std::get_if<T>(&m_value); }
+	storage_type const& storage() const noexcept { return m_value; }
+
+	// Integers and numbers alike.
+	std::optional<lua_Number> number() const noexcept;
+	std::optional<std::string_view> string() const noexcept;
+	// Looks up a field when this is a table.
+	Value const* find(std::string_view key) const;
+	Value const* find(lua_Integer key) const;
+
+	// Compares like Lua's raw equality, except that tables compare by
+	// content: 1 == 1.0, but "1" != 1.
+	bool operator==(Value const& o) const;
+	bool operator!=(Value const& o) const { return !(*this == o); }
+
+private:
+	storage_type m_value;
+};
+
+inline std::size_t ValueTable::hashSize() const noexcept {
+	return (m_values.size() - m_arraySize) / 2;
+}
+inline Value const& ValueTable::element(std::size_t i) const {
+	return m_values[i];
+}
+inline Value const& ValueTable::key(std::size_t i) const {
+	return m_values[m_arraySize + 2 * i];
+}
+inline Value const& ValueTable::value(std::size_t i) const {
+	return m_values[m_arraySize + 2 * i + 1];
+}
+
+template <>
+struct TypeConverter<Value> {
+	typedef std::optional<Value> Arg;
+	static Arg Read(Lua::State& s, int id) { return Value::Read(s, id); }
+	static std::size_t Push(Lua::State& s, Value const& v) {
+		v.push(s);
+		return 1;
+	}
+	static std::string Name() { return "value"; }
+	static char const* TypeName() { return "value"; }
+};
+
+}
+
+#endif
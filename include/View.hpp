@@ -0,0 +1,342 @@
+/*	Copyright (c) 2023 Mauro Grassia
+**	
+**	Permission is granted to use, modify and redistribute this software.
+**	Modified versions of this software MUST be marked as such.
+**	
+**	This software is provided "AS IS". In no event shall
+**	the authors or copyright holders be liable for any claim,
+**	damages or other liability. The above copyright notice
+**	and this permission notice shall be included in all copies
+**	or substantial portions of the software.
+**	
+*/
+
+#ifndef LUAPP_VIEW_HPP
+#define LUAPP_VIEW_HPP
+
+#include "LuaInclude.hpp"
+#include "State.hpp"
+#include "TypeConverter.hpp"
+#include "Operators.hpp"
+
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+/*	Containers pushed by reference instead of being copied into a table:
+ *
+ *		state.luapp_push_value(Lua::View(items));         // t[i] = v allowed
+ *		state.luapp_push_value(Lua::ReadOnlyView(items)); // t[i] = v raises an error
+ *		...
+ *		state.luapp_invalidate_view(&items);              // Before items goes away
+ *
+ *	The proxy supports t[k], t[k] = v, #t and pairs(t) on the live container.
+ *	Sequences are indexed from 1 and grow by assigning to #t + 1; assigning
+ *	nil to a key of a map erases it. A view must not outlive its container:
+ *	once invalidated, every access raises an error. Views of const containers
+ *	are read-only.
+ */
+
+namespace Lua {
+
+template <typename C>
+class ContainerView {
+	C* m_container;
+
+public:
+	typedef typename std::remove_const<C>::type container_type;
+	static constexpr bool is_mutable = !std::is_const<C>::value;
+
+	explicit ContainerView(C& container)
+		: m_container(&container) {}
+
+	C* get() const { return m_container; }
+	C& operator*() const { return *m_container; }
+	C* operator->() const { return m_container; }
+};
+
+template <typename C>
+ContainerView<C> View(C& container) {
+	return ContainerView<C>(container);
+}
+template <typename C>
+ContainerView<C const> ReadOnlyView(C const& container) {
+	return ContainerView<C const>(container);
+}
+
+namespace impl {
+
+// Pushes the cell shared by every view of the container in this State.
+// It holds the container address until luapp_invalidate_view clears it.
+void const* const* PushViewCell(lua_State* state, void const* container);
+
+template <typename C, typename = void>
+struct IsMappedContainer : std::false_type {};
+template <typename C>
+struct IsMappedContainer<C, std::void_t<typename C::mapped_type>> : std::true_type {};
+
+template <typename C, typename = void>
+struct HasPushBack : std::false_type {};
+template <typename C>
+struct HasPushBack<C, std::void_t<decltype(std::declval<C&>().push_back(std::declval<typename C::value_type>()))>> : std::true_type {};
+
+template <typename C>
+struct ViewProxy {
+	typedef typename std::remove_const<C>::type container_type;
+	typedef decltype(std::declval<C&>().begin()) iterator;
+
+	static constexpr bool is_mutable    = !std::is_const<C>::value;
+	static constexpr bool is_mapped     = IsMappedContainer<container_type>::value;
+	static constexpr bool random_access = std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<iterator>::iterator_category>::value;
+
+	// The proxy userdata; its user value keeps the cell alive.
+	struct Proxy {
+		void const* const* cell;
+	};
+	// Traversal state of pairs() on containers without random access.
+	// It points past the element last returned, so that erasing that
+	// element during the traversal is allowed.
+	struct Cursor {
+		iterator next;
+		lua_Integer position;
+	};
+
+	static char const* MetatableKey() {
+		static char const key = 0;
+		return &key;
+	}
+	static char const* CursorMetatableKey() {
+		static char const key = 0;
+		return &key;
+	}
+
+	static void Push(lua_State* state, C* container) {
+		Proxy* proxy = static_cast<Proxy*>(lua_newuserdatauv(state, sizeof(Proxy), 1));
+		proxy->cell  = PushViewCell(state, container);
+		lua_setiuservalue(state, -2, 1);
+		PushMetatable(state);
+		lua_setmetatable(state, -2);
+	}
+	// The container of the view at arg, or nullptr if it is not such a
+	// view or was invalidated.
+	static C* Test(lua_State* state, int arg) {
+		Proxy* proxy = static_cast<Proxy*>(TestUdata(state, arg, MetatableKey()));
+		if(!proxy)
+			return nullptr;
+		return static_cast<C*>(const_cast<void*>(*proxy->cell));
+	}
+
+private:
+	static void PushMetatable(lua_State* state) {
+		if(lua_rawgetp(state, LUA_REGISTRYINDEX, MetatableKey()) == LUA_TTABLE)
+			return;
+		lua_pop(state, 1);
+
+		lua_createtable(state, 0, 5);
+		lua_pushcfunction(state, &ViewProxy::Index);
+		lua_setfield(state, -2, "__index");
+		lua_pushcfunction(state, &ViewProxy::NewIndex);
+		lua_setfield(state, -2, "__newindex");
+		lua_pushcfunction(state, &ViewProxy::Length);
+		lua_setfield(state, -2, "__len");
+		lua_pushcfunction(state, &ViewProxy::Pairs);
+		lua_setfield(state, -2, "__pairs");
+		lua_pushliteral(state, "Lua::View");
+		lua_setfield(state, -2, "__name");
+		lua_pushvalue(state, -1);
+		lua_rawsetp(state, LUA_REGISTRYINDEX, MetatableKey());
+	}
+
+	// The metamethods can be called with anything, e.g. through getmetatable.
+	static C* Container(lua_State* state, int arg) {
+		Proxy* proxy = static_cast<Proxy*>(CheckUdata(state, arg, MetatableKey(), "Lua::View"));
+		if(!*proxy->cell)
+			luaL_error(state, "C++ / Lua Error: The container of this view no longer exists.");
+		return static_cast<C*>(const_cast<void*>(*proxy->cell));
+	}
+	// 1-based position of the key at arg, or 0 when it is not in [1, limit].
+	static std::size_t Position(lua_State* state, int arg, std::size_t limit) {
+		if(lua_type(state, arg) != LUA_TNUMBER)
+			return 0;
+		int isnum       = 0;
+		lua_Integer key = lua_tointegerx(state, arg, &isnum);
+		if(!isnum || key < 1 || static_cast<lua_Unsigned>(key) > limit)
+			return 0;
+		return static_cast<std::size_t>(key);
+	}
+
+	static int Index(lua_State* state) {
+		C* container = Container(state, 1);
+		if constexpr(is_mapped) {
+			return CallOperator(state, "__index", [container](Lua::State& s) -> int {
+				std::optional<typename container_type::key_type> key = TypeConverter<typename container_type::key_type>::Read(s, 2);
+				if(!key)
+					return 0;
+				auto it = container->find(*key);
+				if(it == container->end())
+					return 0;
+				return static_cast<int>(TypeConverter<typename container_type::mapped_type>::Push(s, it->second));
+			});
+		}
+		else {
+			std::size_t const position = Position(state, 2, container->size());
+			if(!position)
+				return 0;
+			return CallOperator(state, "__index", [container, position](Lua::State& s) -> int {
+				return static_cast<int>(TypeConverter<typename container_type::value_type>::Push(s, *std::next(container->begin(), position - 1)));
+			});
+		}
+	}
+	static int NewIndex(lua_State* state) {
+		if constexpr(!is_mutable)
+			return luaL_error(state, "C++ / Lua Error: Cannot modify a read-only view.");
+		else {
+			C* container = Container(state, 1);
+			bool accepted = true;
+			if constexpr(is_mapped) {
+				CallOperator(state, "__newindex", [container, &accepted](Lua::State& s) -> int {
+					std::optional<typename container_type::key_type> key = TypeConverter<typename container_type::key_type>::Read(s, 2);
+					if(!key) {
+						accepted = false;
+						return 0;
+					}
+					if(s.isnil(3)) {
+						container->erase(*key);
+						return 0;
+					}
+					std::optional<typename container_type::mapped_type> value = TypeConverter<typename container_type::mapped_type>::Read(s, 3);
+					if(!value) {
+						accepted = false;
+						return 0;
+					}
+					container->insert_or_assign(std::move(*key), std::move(*value));
+					return 0;
+				});
+			}
+			else {
+				std::size_t const size     = container->size();
+				std::size_t const position = Position(state, 2, HasPushBack<container_type>::value ? size + 1 : size);
+				if(!position)
+					return luaL_error(state, "C++ / Lua Error: View index %s is out of range (size %d).", luaL_tolstring(state, 2, nullptr), static_cast<int>(size));
+
+				CallOperator(state, "__newindex", [container, position, size, &accepted](Lua::State& s) -> int {
+					std::optional<typename container_type::value_type> value = TypeConverter<typename container_type::value_type>::Read(s, 3);
+					if(!value)
+						accepted = false;
+					else if(position <= size)
+						*std::next(container->begin(), position - 1) = std::move(*value);
+					else if constexpr(HasPushBack<container_type>::value)
+						container->push_back(std::move(*value));
+					return 0;
+				});
+			}
+			if(!accepted)
+				return luaL_error(state, "C++ / Lua Error: Cannot store a %s key with a %s value in this view.", luaL_typename(state, 2), luaL_typename(state, 3));
+			return 0;
+		}
+	}
+	static int Length(lua_State* state) {
+		lua_pushinteger(state, static_cast<lua_Integer>(Container(state, 1)->size()));
+		return 1;
+	}
+
+	static int Pairs(lua_State* state) {
+		C* container = Container(state, 1);
+		if constexpr(random_access && !is_mapped) {
+			lua_pushcfunction(state, &ViewProxy::Next);
+			lua_pushvalue(state, 1);
+			lua_pushinteger(state, 0);
+			return 3;
+		}
+		else {
+			new(lua_newuserdatauv(state, sizeof(Cursor), 0)) Cursor { container->begin(), 0 };
+			// The metatable identifies cursors, and destroys them if needed.
+			if(lua_rawgetp(state, LUA_REGISTRYINDEX, CursorMetatableKey()) != LUA_TTABLE) {
+				lua_pop(state, 1);
+				lua_createtable(state, 0, 1);
+				if constexpr(!std::is_trivially_destructible<Cursor>::value) {
+					lua_pushcfunction(state, &ViewProxy::DestroyCursor);
+					lua_setfield(state, -2, "__gc");
+				}
+				lua_pushvalue(state, -1);
+				lua_rawsetp(state, LUA_REGISTRYINDEX, CursorMetatableKey());
+			}
+			lua_setmetatable(state, -2);
+			// The cursor only walks the container it was made for.
+			lua_pushvalue(state, 1);
+			lua_pushcclosure(state, &ViewProxy::CursorNext, 2);
+			lua_pushvalue(state, 1);
+			lua_pushnil(state);
+			return 3;
+		}
+	}
+	// Like ipairs, with the position as the control variable.
+	static int Next(lua_State* state) {
+		C* container = Container(state, 1);
+		std::size_t const position = static_cast<std::size_t>(luaL_checkinteger(state, 2)) + 1;
+		if(position > container->size())
+			return 0;
+		lua_pushinteger(state, static_cast<lua_Integer>(position));
+		return 1 + CallOperator(state, "__pairs", [container, position](Lua::State& s) -> int {
+			return static_cast<int>(TypeConverter<typename container_type::value_type>::Push(s, (*container)[position - 1]));
+		});
+	}
+	// The cursor and the view are the upvalues.
+	static int CursorNext(lua_State* state) {
+		Cursor* cursor = static_cast<Cursor*>(TestUdata(state, lua_upvalueindex(1), CursorMetatableKey()));
+		if(!cursor || !TestUdata(state, lua_upvalueindex(2), MetatableKey()))
+			return luaL_error(state, "C++ / Lua Error: Invalid view traversal state.");
+		C* container = Container(state, lua_upvalueindex(2));
+		if(cursor->next == container->end())
+			return 0;
+
+		iterator current = cursor->next++;
+		++cursor->position;
+		return CallOperator(state, "__pairs", [current, cursor](Lua::State& s) -> int {
+			if constexpr(is_mapped) {
+				TypeConverter<typename container_type::key_type>::Push(s, current->first);
+				TypeConverter<typename container_type::mapped_type>::Push(s, current->second);
+			}
+			else {
+				s.pushinteger(cursor->position);
+				TypeConverter<typename container_type::value_type>::Push(s, *current);
+			}
+			return 2;
+		});
+	}
+	static int DestroyCursor(lua_State* state) {
+		if(Cursor* cursor = static_cast<Cursor*>(TestUdata(state, 1, CursorMetatableKey()))) {
+			cursor->~Cursor();
+			lua_pushnil(state);
+			lua_setmetatable(state, 1);
+		}
+		return 0;
+	}
+};
+
+}
+
+template <typename C>
+struct TypeConverter<ContainerView<C>> {
+	typedef std::optional<ContainerView<C>> Arg;
+	static Arg Read(Lua::State& s, int id) {
+		C* container = impl::ViewProxy<C>::Test(s.GetState(), id);
+		if(!container)
+			return std::nullopt;
+		return ContainerView<C>(*container);
+	}
+	static std::size_t Push(Lua::State& s, ContainerView<C> const& v) {
+		impl::ViewProxy<C>::Push(s.GetState(), v.get());
+		return 1;
+	}
+	static std::string Name() { return "view"; }
+	static char const* TypeName() { return "view"; }
+};
+
+}
+
+#endif
@@ -1,46 +1,40 @@
 #include "Functor.hpp"
 #include "Utils.hpp"
-#include "StateManager.hpp"
 #include "State.hpp"
 #include <memory>
 
 namespace Lua::impl {
 
+// The luapp_functor metatable is also stored in the registry under this address.
+static char const functorMetatableKey = 0;
+
 int Functor::RegisterMetatable(lua_State* state) {
 	luaL_newmetatable(state, "luapp_functor");
-	lua_pushcfunction(state, &Functor::Destroy);
+	lua_pushvalue(state, -1);
+	lua_rawsetp(state, LUA_REGISTRYINDEX, &functorMetatableKey);
+	// The metatable is the upvalue of its metamethods, to check the functor against.
+	lua_pushvalue(state, -1);
+	lua_pushcclosure(state, &Functor::Destroy, 1);
 	lua_setfield(state, -2, "__gc");
-	lua_pushcfunction(state, &Functor::Call);
+	lua_pushvalue(state, -1);
+	lua_pushcclosure(state, &Functor::Call, 1);
 	lua_setfield(state, -2, "__call");
 	lua_pop(state, 1);
 	return 0;
 }
 
 int Functor::Call(lua_State* s) {
-	std::shared_ptr<Lua::State> state = Lua::StateManager::Get().Find(s);
-	if(!state)
-		return 0;
-
-	functor_type* p = (functor_type*)(state->checkudata(1, "luapp_functor"));
-	if(!p || !(*p))
-		return 0;
-
-	try {
-		return (*p)(*state);
-	}
-	catch(lua_exception& e) {
-		return state->error("C++ / Lua Exception: %s", e.what());
-	}
-	catch(std::exception& e) {
-		return state->error("C++ Exception: %s", e.what());
-	}
-	catch(...) {
-		return state->error("Unknown C++ Exception thrown.");
-	}
+	int const results = Lua::State::WithState(s, [s](Lua::State& state) -> int {
+		functor_type* p = (functor_type*)(CheckUdataAt(s, 1, lua_upvalueindex(1), "luapp_functor"));
+		if(!p || !(*p))
+			return 0;
+		return CatchExceptions(s, [p, &state] { return (*p)(state); });
+	});
+	return results < 0 ? lua_error(s) : results;
 }
 
 int Functor::Destroy(lua_State* state) {
-	functor_type* p = (functor_type*)(luaL_checkudata(state, 1, "luapp_functor"));
+	functor_type* p = (functor_type*)(TestUdataAt(state, 1, lua_upvalueindex(1)));
 	if(p) {
 		p->~functor_type();
 		markAllocation(AT_UDATA, -1);
@@ -60,7 +54,7 @@ int Functor::Push(lua_State* s, functor_type f) {
 
 	markAllocation(AT_UDATA, +1);
 	new(p) functor_type(std::move(f));
-	luaL_getmetatable(s, "luapp_functor");
+	lua_rawgetp(s, LUA_REGISTRYINDEX, &functorMetatableKey);
 	lua_setmetatable(s, -2);
 	return 1;
 }
@@ -0,0 +1,91 @@
+#include "State.hpp"
+#include "Utils.hpp"
+#include <new>
+
+namespace Lua {
+
+namespace {
+// The std::function entries of one library, stored after the count.
+struct LibraryStorage {
+	std::size_t count;
+
+	std::function<int(Lua::State&)>* functions() { return reinterpret_cast<std::function<int(Lua::State&)>*>(this + 1); }
+};
+static_assert(sizeof(LibraryStorage) % alignof(std::function<int(Lua::State&)>) == 0, "Misaligned library storage.");
+
+// The library storage metatable is stored in the registry under this address.
+char const libraryMetatableKey = 0;
+
+int DestroyLibrary(lua_State* s) {
+	LibraryStorage* storage = static_cast<LibraryStorage*>(lua_touserdata(s, 1));
+	if(storage) {
+		for(std::size_t i = 0; i < storage->count; ++i)
+			storage->functions()[i].~function();
+		storage->count = 0;
+		markAllocation(AT_UDATA, -1);
+	}
+	return 0;
+}
+
+// The storage and the position of the function in it are the upvalues.
+int CallLibraryFunction(lua_State* s) {
+	LibraryStorage* storage                          = static_cast<LibraryStorage*>(lua_touserdata(s, lua_upvalueindex(1)));
+	std::function<int(Lua::State&)> const& function = storage->functions()[lua_tointeger(s, lua_upvalueindex(2))];
+
+	// Translated functions expect their Functor at index 1.
+	lua_pushvalue(s, lua_upvalueindex(1));
+	lua_insert(s, 1);
+
+	int const results = State::WithState(s, [s, &function](Lua::State& state) -> int {
+		return impl::CatchExceptions(s, [&function, &state] { return function(state); });
+	});
+	return results < 0 ? lua_error(s) : results;
+}
+}
+
+void State::luapp_register_library(char const* name, std::initializer_list<LibraryFunction> functions) {
+	lua_State* s = GetState();
+
+	std::size_t count = 0;
+	for(LibraryFunction const& entry : functions)
+		if(!entry.cfunction() && entry.function())
+			++count;
+
+	lua_createtable(s, 0, static_cast<int>(functions.size()));
+	int const table = lua_gettop(s);
+
+	// One userdata holds every std::function of the library.
+	LibraryStorage* storage = nullptr;
+	if(count > 0) {
+		storage = new(lua_newuserdatauv(s, sizeof(LibraryStorage) + count * sizeof(std::function<int(Lua::State&)>), 0)) LibraryStorage { 0 };
+		markAllocation(AT_UDATA, +1);
+		if(lua_rawgetp(s, LUA_REGISTRYINDEX, &libraryMetatableKey) != LUA_TTABLE) {
+			lua_pop(s, 1);
+			lua_createtable(s, 0, 1);
+			lua_pushcfunction(s, &DestroyLibrary);
+			lua_setfield(s, -2, "__gc");
+			lua_pushvalue(s, -1);
+			lua_rawsetp(s, LUA_REGISTRYINDEX, &libraryMetatableKey);
+		}
+		lua_setmetatable(s, -2);
+	}
+
+	for(LibraryFunction const& entry : functions) {
+		if(lua_CFunction cfunction = entry.cfunction())
+			lua_pushcfunction(s, cfunction);
+		else if(entry.function()) {
+			new(storage->functions() + storage->count) std::function<int(Lua::State&)>(entry.function());
+			lua_pushvalue(s, table + 1);
+			lua_pushinteger(s, static_cast<lua_Integer>(storage->count++));
+			lua_pushcclosure(s, &CallLibraryFunction, 2);
+		}
+		else
+			continue;
+		lua_setfield(s, table, entry.name());
+	}
+
+	lua_settop(s, table);
+	lua_setglobal(s, name);
+}
+
+}
@@ -0,0 +1,78 @@
+#include "PropertyIndex.hpp"
+#include <new>
+
+namespace Lua::impl {
+
+PropertyIndex* PropertyIndex::Push(lua_State* state, std::vector<std::string_view> const& names) {
+	std::vector<Slot> interned;
+	std::vector<Fallback> fallback;
+
+	// Lua copies of the names, referenced by the userdata.
+	lua_createtable(state, static_cast<int>(names.size()), 0);
+	for(std::size_t i = 0; i < names.size(); ++i) {
+		int const position = static_cast<int>(i);
+		char const* key    = lua_pushlstring(state, names[i].data(), names[i].size());
+		// Pushing an interned string again yields the same object.
+		bool const isInterned = lua_pushlstring(state, names[i].data(), names[i].size()) == key;
+		lua_pop(state, 1);
+		lua_rawseti(state, -2, position + 1);
+
+		if(isInterned)
+			interned.push_back({ key, position });
+		else
+			fallback.push_back({ key, names[i].size(), position });
+	}
+
+	// Looks for a multiplier that gives every interned key its own slot,
+	// doubling the table after a few failed attempts.
+	std::vector<Slot> slots;
+	std::uint64_t multiplier = 0;
+	unsigned bits            = 1;
+	while((std::size_t(1) << bits) < interned.size() * 2)
+		++bits;
+
+	std::uint64_t seed = 0x9E3779B97F4A7C15ull;
+	for(bool found = false; !found;) {
+		if(bits > 20) {
+			// Not expected to happen; every key is then compared by content.
+			for(Slot const& slot : interned)
+				fallback.push_back({ slot.key, std::strlen(slot.key), slot.position });
+			interned.clear();
+			bits = 1;
+		}
+
+		for(int attempt = 0; attempt < 16 && !found; ++attempt) {
+			seed       = seed * 6364136223846793005ull + 1442695040888963407ull;
+			multiplier = seed | 1;
+
+			slots.assign(std::size_t(1) << bits, Slot { nullptr, -1 });
+			found = true;
+			for(Slot const& slot : interned) {
+				Slot& destination = slots[Hash(slot.key, multiplier, 64 - bits)];
+				if(destination.key) {
+					found = false;
+					break;
+				}
+				destination = slot;
+			}
+		}
+		if(!found)
+			++bits;
+	}
+
+	std::size_t const size = sizeof(PropertyIndex) + slots.size() * sizeof(Slot) + fallback.size() * sizeof(Fallback);
+	PropertyIndex* index   = new(lua_newuserdatauv(state, size, 1)) PropertyIndex();
+	index->m_multiplier    = multiplier;
+	index->m_shift         = 64 - bits;
+	index->m_slotCount     = static_cast<unsigned>(slots.size());
+	index->m_fallbackCount = static_cast<unsigned>(fallback.size());
+	std::memcpy(const_cast<Slot*>(index->slots()), slots.data(), slots.size() * sizeof(Slot));
+	if(!fallback.empty())
+		std::memcpy(const_cast<Fallback*>(index->fallbacks()), fallback.data(), fallback.size() * sizeof(Fallback));
+
+	lua_insert(state, -2);
+	lua_setiuservalue(state, -2, 1);
+	return index;
+}
+
+}
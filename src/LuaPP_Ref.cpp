@@ -0,0 +1,236 @@
+#include "Ref.hpp"
+#include "State.hpp"
+#include "Utils.hpp"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+
+namespace Lua {
+
+namespace impl {
+// Only registry keys are queued.
+struct ReleaseQueue::Node {
+	Node* next;
+	std::uint32_t generation;
+	int key;
+};
+}
+
+namespace {
+void DeleteReleases(impl::ReleaseQueue::Node* node) noexcept {
+	while(node) {
+		impl::ReleaseQueue::Node* next = node->next;
+		delete node;
+		node = next;
+	}
+}
+
+// Slots live in fixed chunks that are never moved or freed, so a Ref can
+// look its slot up without a lock while States are opened elsewhere.
+class StateSlots {
+	static constexpr std::size_t ChunkBits = 8;
+	static constexpr std::size_t ChunkSize = std::size_t(1) << ChunkBits;
+	static constexpr std::size_t MaxChunks = 4096;
+
+	// The state and generation are also read by other threads, without the lock.
+	struct Slot {
+		std::atomic<lua_State*> state;
+		std::atomic<std::uint32_t> generation;
+		std::atomic<std::thread::id> owner;
+		std::uint32_t nextFree;
+		impl::ReleaseQueue releases;
+	};
+
+	std::mutex m_mutex;
+	std::unique_ptr<Slot[]> m_chunks[MaxChunks];
+	std::uint32_t m_count    = 1; // Slot 0 is never used
+	std::uint32_t m_freeList = 0;
+
+public:
+	// Never destroyed, so that Refs released after main returns are safe.
+	static StateSlots& Instance() {
+		static StateSlots* slots = new StateSlots();
+		return *slots;
+	}
+
+	Slot* Find(std::uint32_t slot) noexcept {
+		Slot* chunk = m_chunks[slot >> ChunkBits].get();
+		return chunk ? &chunk[slot & (ChunkSize - 1)] : nullptr;
+	}
+
+	std::uint32_t Acquire(lua_State* state, std::uint32_t& generation, impl::ReleaseQueue*& releases) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::uint32_t slot = m_freeList;
+		if(slot)
+			m_freeList = Find(slot)->nextFree;
+		else {
+			// Without a free slot, Refs into this State are never valid.
+			if(m_count >= MaxChunks * ChunkSize)
+				return 0;
+			slot = m_count++;
+			if(!m_chunks[slot >> ChunkBits])
+				m_chunks[slot >> ChunkBits].reset(new Slot[ChunkSize]());
+		}
+
+		Slot* entry = Find(slot);
+		entry->owner.store(std::this_thread::get_id(), std::memory_order_relaxed);
+		entry->state.store(state, std::memory_order_release);
+		generation = entry->generation.load(std::memory_order_relaxed);
+		releases   = &entry->releases;
+		return slot;
+	}
+	void Release(std::uint32_t slot) noexcept {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Slot* entry = Find(slot);
+		entry->state.store(nullptr, std::memory_order_relaxed);
+		entry->generation.fetch_add(1, std::memory_order_release);
+		// Releases queued late carry the old generation; the next owner drops them.
+		DeleteReleases(entry->releases.head.exchange(nullptr, std::memory_order_acquire));
+		entry->nextFree = m_freeList;
+		m_freeList      = slot;
+	}
+};
+}
+
+namespace impl {
+std::uint32_t AcquireStateSlot(lua_State* state, std::uint32_t& generation, ReleaseQueue*& releases) {
+	return StateSlots::Instance().Acquire(state, generation, releases);
+}
+void ReleaseStateSlot(std::uint32_t slot) noexcept {
+	if(slot)
+		StateSlots::Instance().Release(slot);
+}
+void ClaimStateSlot(std::uint32_t slot) noexcept {
+	if(slot)
+		StateSlots::Instance().Find(slot)->owner.store(std::this_thread::get_id(), std::memory_order_relaxed);
+}
+lua_State* FindStateSlot(std::uint32_t slot, std::uint32_t generation) noexcept {
+	if(!slot)
+		return nullptr;
+	auto* entry = StateSlots::Instance().Find(slot);
+	if(!entry || entry->generation.load(std::memory_order_acquire) != generation)
+		return nullptr;
+	return entry->state.load(std::memory_order_acquire);
+}
+lua_State* FindOwnedStateSlot(std::uint32_t slot, std::uint32_t generation) noexcept {
+	lua_State* state = FindStateSlot(slot, generation);
+	if(!state || StateSlots::Instance().Find(slot)->owner.load(std::memory_order_relaxed) != std::this_thread::get_id())
+		return nullptr;
+	return state;
+}
+
+void ReleaseReference(std::uint32_t slot, std::uint32_t generation, int table, int key) noexcept {
+	if(!slot || key == LUA_NOREF || key == LUA_REFNIL)
+		return;
+	auto* entry = StateSlots::Instance().Find(slot);
+	if(!entry || entry->generation.load(std::memory_order_acquire) != generation)
+		return;
+
+	// luaL_unref needs one free stack slot.
+	lua_State* state = FindOwnedStateSlot(slot, generation);
+	if(state && lua_checkstack(state, 1)) {
+		luaL_unref(state, table, key);
+		return;
+	}
+	if(table != LUA_REGISTRYINDEX)
+		return;
+
+	// Out of memory, the value simply stays alive until the State is closed.
+	ReleaseQueue::Node* node = new(std::nothrow) ReleaseQueue::Node { nullptr, generation, key };
+	if(!node)
+		return;
+	node->next = entry->releases.head.load(std::memory_order_relaxed);
+	while(!entry->releases.head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)) {
+	}
+}
+void ApplyReleases(lua_State* state, ReleaseQueue& releases, std::uint32_t generation) noexcept {
+	// Taking the whole stack at once leaves no room for ABA.
+	ReleaseQueue::Node* node = releases.head.exchange(nullptr, std::memory_order_acquire);
+	for(ReleaseQueue::Node* it = node; it; it = it->next)
+		if(it->generation == generation)
+			luaL_unref(state, LUA_REGISTRYINDEX, it->key);
+	DeleteReleases(node);
+}
+}
+
+Ref::Ref(Ref const& o)
+	: m_slot(o.m_slot),
+	  m_generation(o.m_generation),
+	  m_key(o.m_key) {
+	if(m_key == LUA_NOREF || m_key == LUA_REFNIL)
+		return;
+
+	lua_State* s = impl::FindOwnedStateSlot(m_slot, m_generation);
+	if(!s && impl::FindStateSlot(m_slot, m_generation))
+		throw lua_exception("Lua::Ref: Copied on a thread that does not own its State.");
+	if(!s) {
+		m_key = LUA_NOREF;
+		return;
+	}
+	lua_rawgeti(s, LUA_REGISTRYINDEX, o.m_key);
+	m_key = luaL_ref(s, LUA_REGISTRYINDEX);
+}
+Ref& Ref::operator=(Ref const& o) {
+	if(this != &o)
+		*this = Ref(o);
+	return *this;
+}
+Ref& Ref::operator=(Ref&& o) noexcept {
+	if(this != &o) {
+		reset();
+		m_slot       = o.m_slot;
+		m_generation = o.m_generation;
+		m_key        = o.m_key;
+		o.m_key      = LUA_NOREF;
+	}
+	return *this;
+}
+
+void Ref::reset() noexcept {
+	impl::ReleaseReference(m_slot, m_generation, LUA_REGISTRYINDEX, m_key);
+	m_key = LUA_NOREF;
+}
+
+Ref::operator bool() const noexcept {
+	return m_key != LUA_NOREF && m_key != LUA_REFNIL && impl::FindStateSlot(m_slot, m_generation);
+}
+lua_State* Ref::state() const noexcept {
+	return impl::FindStateSlot(m_slot, m_generation);
+}
+
+Ref State::luapp_pop_ref() {
+	State* main = owner();
+	if(!main->m_slot) {
+		pop(1);
+		return Ref();
+	}
+	// Reuses the keys released since the last call.
+	luapp_drain_releases();
+	return Ref(main->m_slot, main->m_generation, luaL_ref(m_state, LUA_REGISTRYINDEX));
+}
+Ref State::luapp_read_ref(int index) {
+	pushvalue(index);
+	return luapp_pop_ref();
+}
+// The Ref is checked against this State directly, without the slot table.
+void State::luapp_push_ref(Ref const& ref) {
+	State const* main = owner();
+	if(!ref.m_slot || ref.m_slot != main->m_slot || ref.m_generation != main->m_generation)
+		pushnil();
+	else
+		lua_rawgeti(m_state, LUA_REGISTRYINDEX, ref.m_key);
+}
+
+void State::luapp_claim_thread() {
+	impl::ClaimStateSlot(owner()->m_slot);
+}
+void State::luapp_drain_releases() {
+	State* main = owner();
+	if(m_state && main->m_releases)
+		impl::ApplyReleases(m_state, *main->m_releases, main->m_generation);
+}
+
+}
@@ -3,15 +3,45 @@
 
 namespace Lua {
 
+static_assert(LUA_EXTRASPACE >= sizeof(State*), "LuaPP stores its State pointer in the lua_State extra space.");
+
 State::State()
-	: m_state(luaL_newstate()) {}
+	: m_state(luaL_newstate()),
+	  m_owner(nullptr),
+	  m_slot(0),
+	  m_generation(0),
+	  m_releases(nullptr) {
+	bindExtraSpace();
+	if(m_state)
+		m_slot = impl::AcquireStateSlot(m_state, m_generation, m_releases);
+}
+State::State(lua_State* thread, State& owner)
+	: m_state(thread),
+	  m_owner(owner.owner()),
+	  m_slot(0),
+	  m_generation(0),
+	  m_releases(nullptr) {}
 State::State(State&& o)
-	: m_state(nullptr) {
+	: m_state(nullptr),
+	  m_owner(nullptr),
+	  m_slot(0),
+	  m_generation(0),
+	  m_releases(nullptr) {
 	*this = std::move(o);
 }
 State& State::operator=(State&& o) {
 	std::swap(m_state, o.m_state);
+	std::swap(m_owner, o.m_owner);
 	std::swap(m_self, o.m_self);
+	std::swap(m_slot, o.m_slot);
+	std::swap(m_generation, o.m_generation);
+	std::swap(m_releases, o.m_releases);
+	std::swap(m_metatables, o.m_metatables);
+	std::swap(m_pools, o.m_pools);
+	// The lua_State that o now holds must find o, whose metatables and pools
+	// its __gc handlers check and release against.
+	bindExtraSpace();
+	o.bindExtraSpace();
 	o.close();
 	return *this;
 }
@@ -19,13 +49,24 @@ State::~State() {
 	close();
 }
 
+void State::bindExtraSpace() noexcept {
+	if(m_state && !m_owner)
+		*static_cast<State**>(lua_getextraspace(m_state)) = this;
+}
 void State::setSelf(std::weak_ptr<State> self) {
 	m_self = self;
 }
 void State::close() {
 	if(!m_state)
 		return;
-	lua_close(m_state);
+	if(!m_owner) {
+		// Refs into this State become invalid before it goes away. The slot
+		// is kept, as other threads may still read it to queue releases.
+		impl::ReleaseStateSlot(m_slot);
+		lua_close(m_state);
+		m_metatables.clear();
+		m_pools.clear(); // After lua_close released the pooled objects
+	}
 	m_state = nullptr;
 }
 
@@ -69,28 +110,42 @@ std::string State::checkstdstring(int index) {
 }
 
 std::shared_ptr<Reference> State::luapp_pop_reference(int refTable) {
-	return std::shared_ptr<Reference>(new Reference(m_self, refTable, ref(refTable)));
+	luapp_drain_releases();
+	return std::shared_ptr<Reference>(new Reference(owner()->m_self, refTable, ref(refTable)));
 }
 std::shared_ptr<Reference> State::luapp_read_reference(int index, int refTable) {
 	pushvalue(index);
 	return luapp_pop_reference(refTable);
 }
 void State::luapp_push_reference(std::shared_ptr<Reference> reference) {
-	if(!reference || !*reference || reference->state().lock() != m_self.lock())
+	if(!reference || !*reference || !luapp_owns_reference(*reference))
 		pushnil();
 	else
 		rawgeti(reference->table(), reference->key());
 }
 void State::luapp_destroy_reference(std::shared_ptr<Reference> reference) {
-	luapp_destroy_reference(reference.get());
+	// Resetting the Reference keeps its destructor from releasing it again.
+	if(reference && reference->state().lock() == owner()->m_self.lock())
+		reference->destroy();
 }
+// Runs on whichever thread drops the Reference, see impl::ReleaseReference.
 void State::luapp_destroy_reference(Reference* reference) {
-	if(!m_state || !reference || !*reference || reference->state().lock() != m_self.lock())
+	if(!reference || !*reference || reference->state().lock() != owner()->m_self.lock())
 		return;
-	unref(reference->table(), reference->key());
+	State* main = owner();
+	impl::ReleaseReference(main->m_slot, main->m_generation, reference->table(), reference->key());
+}
+// Compares the owners of the weak_ptrs, which needs no locking.
+bool State::luapp_owns_reference(Reference const& reference) const noexcept {
+	std::weak_ptr<State> const& self = owner()->m_self;
+	return !reference.m_state.owner_before(self) && !self.owner_before(reference.m_state);
+}
+int State::luapp_push_translated_function(std::function<int(Lua::State&)> function) {
+	return impl::Functor::Push(GetState(), std::move(function));
 }
-int State::luapp_push_translated_function(std::function<int(Lua::State&)> const& function) {
-	return impl::Functor::Push(GetState(), function);
+int State::luapp_push_translated_function(lua_CFunction function) {
+	pushcfunction(function);
+	return 1;
 }
 
 }
@@ -1,4 +1,5 @@
 #include "Utils.hpp"
+#include <atomic>
 
 #if _DEBUG
 #	include <map>
@@ -38,4 +39,11 @@ char const* lua_exception::what() const noexcept {
 	return m_what.c_str();
 }
 
+namespace impl {
+std::size_t NextTypeId() noexcept {
+	static std::atomic<std::size_t> next { 0 };
+	return next.fetch_add(1, std::memory_order_relaxed);
+}
+}
+
 }
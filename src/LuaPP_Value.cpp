@@ -0,0 +1,476 @@
+#include "Value.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <new>
+
+namespace Lua {
+
+SmallString::SmallString(char const* data, std::size_t size)
+	: m_size(size) {
+	char* destination = m_inline;
+	if(!isInline())
+		destination = m_heap = new char[size + 1];
+	std::memcpy(destination, data, size);
+	destination[size] = '\0';
+}
+SmallString::SmallString(SmallString&& o) noexcept
+	: m_size(o.m_size) {
+	if(isInline())
+		std::memcpy(m_inline, o.m_inline, m_size + 1);
+	else
+		m_heap = o.m_heap;
+
+	o.m_size      = 0;
+	o.m_inline[0] = '\0';
+}
+SmallString& SmallString::operator=(SmallString const& o) {
+	if(this != &o)
+		*this = SmallString(o);
+	return *this;
+}
+SmallString& SmallString::operator=(SmallString&& o) noexcept {
+	if(this != &o) {
+		this->~SmallString();
+		new(this) SmallString(std::move(o));
+	}
+	return *this;
+}
+SmallString::~SmallString() {
+	if(!isInline())
+		delete[] m_heap;
+}
+
+namespace {
+// Keys compare like Lua keys: floats with an integral value are integers.
+Value NormalizeKey(Value const& key) {
+	if(lua_Number const* n = key.get_if<lua_Number>()) {
+		lua_Number const lower = static_cast<lua_Number>(std::numeric_limits<lua_Integer>::min());
+		if(std::floor(*n) == *n && *n >= lower && *n < -lower)
+			return Value(static_cast<lua_Integer>(*n));
+	}
+	return key;
+}
+
+// Normalized keys are equal when they hold the same alternative.
+bool SameKey(Value const& a, Value const& b) {
+	return a.storage().index() == b.storage().index() && a == b;
+}
+
+std::size_t HashInteger(lua_Integer key) {
+	// The Fibonacci multiplier spreads consecutive integers over the slots.
+	std::uint64_t const bits = static_cast<std::uint64_t>(key) * 0x9E3779B97F4A7C15ull;
+	return static_cast<std::size_t>(bits ^ (bits >> 32));
+}
+std::size_t HashString(std::string_view key) {
+	return std::hash<std::string_view>()(key);
+}
+std::size_t HashKey(Value const& key) {
+	switch(key.storage().index()) {
+	case 0:
+		return 0;
+	case 1:
+		return *key.get_if<bool>() ? 1 : 2;
+	case 2:
+		return HashInteger(*key.get_if<lua_Integer>());
+	case 3:
+		return std::hash<lua_Number>()(*key.get_if<lua_Number>());
+	case 4:
+		return HashString(key.get_if<SmallString>()->view());
+	case 5:
+		{
+			// Cheap, and consistent with comparing the contents.
+			ValueTable const& table = *key.get_if<ValueTable>();
+			return HashInteger(static_cast<lua_Integer>(table.arraySize() + table.hashSize()));
+		}
+	default:
+		{
+			ValueReference const& reference = *key.get_if<ValueReference>();
+			if(reference.address)
+				return std::hash<void const*>()(reference.address);
+			return std::hash<ReferenceType>()(reference.reference);
+		}
+	}
+}
+
+// The number of index slots for count keys: a power of two, at most half
+// full.
+std::size_t IndexCapacity(std::size_t count) {
+	std::size_t capacity = 16;
+	while(capacity < 2 * count)
+		capacity *= 2;
+	return capacity;
+}
+
+// Converts a Lua value and everything it holds.
+class ValueReader {
+	Lua::State& m_state;
+	lua_State* m_lua;
+	std::size_t m_maxDepth;
+	std::vector<void const*> m_path; // The tables being read, outermost first
+
+public:
+	ValueReader(Lua::State& state, std::size_t maxDepth)
+		: m_state(state),
+		  m_lua(state.GetState()),
+		  m_maxDepth(maxDepth) {}
+
+	bool Read(int index, std::size_t depth, Value& out) {
+		switch(lua_type(m_lua, index)) {
+		case LUA_TNONE:
+		case LUA_TNIL:
+			out = Value();
+			return true;
+		case LUA_TBOOLEAN:
+			out = Value(lua_toboolean(m_lua, index) != 0);
+			return true;
+		case LUA_TNUMBER:
+			if(lua_isinteger(m_lua, index))
+				out = Value(lua_tointeger(m_lua, index));
+			else
+				out = Value(lua_tonumber(m_lua, index));
+			return true;
+		case LUA_TSTRING:
+			{
+				std::size_t size = 0;
+				char const* str  = lua_tolstring(m_lua, index, &size);
+				out              = Value(SmallString(str, size));
+				return true;
+			}
+		case LUA_TTABLE:
+			return ReadTable(index, depth, out);
+		default:
+			{
+				Lua::Type const type = static_cast<Lua::Type>(lua_type(m_lua, index));
+				out                  = Value(ValueReference { m_state.luapp_read_reference(index), type, lua_topointer(m_lua, index) });
+				return true;
+			}
+		}
+	}
+
+	// Walks the tables as Read does, without converting them.
+	bool Check(int index, std::size_t depth) {
+		if(lua_type(m_lua, index) != LUA_TTABLE)
+			return true;
+
+		void const* address = lua_topointer(m_lua, index);
+		if(depth >= m_maxDepth || std::find(m_path.begin(), m_path.end(), address) != m_path.end())
+			return false;
+		if(!lua_checkstack(m_lua, 4))
+			return false;
+
+		index         = lua_absindex(m_lua, index);
+		int const top = lua_gettop(m_lua);
+		m_path.push_back(address);
+
+		bool checked = true;
+		lua_pushnil(m_lua);
+		while(checked && lua_next(m_lua, index)) {
+			checked = Check(-2, depth + 1) && Check(-1, depth + 1);
+			lua_pop(m_lua, 1);
+		}
+
+		lua_settop(m_lua, top);
+		m_path.pop_back();
+		return checked;
+	}
+
+private:
+	bool ReadTable(int index, std::size_t depth, Value& out) {
+		void const* address = lua_topointer(m_lua, index);
+		if(depth >= m_maxDepth || std::find(m_path.begin(), m_path.end(), address) != m_path.end())
+			return false;
+		if(!lua_checkstack(m_lua, 4))
+			return false;
+
+		index         = lua_absindex(m_lua, index);
+		int const top = lua_gettop(m_lua);
+		m_path.push_back(address);
+
+		ValueTable table;
+		lua_Unsigned const arraySize = lua_rawlen(m_lua, index);
+		table.reserve(static_cast<std::size_t>(arraySize), 0);
+
+		bool read = true;
+		for(lua_Unsigned i = 1; read && i <= arraySize; ++i) {
+			lua_rawgeti(m_lua, index, static_cast<lua_Integer>(i));
+			Value element;
+			read = Read(-1, depth + 1, element);
+			lua_pop(m_lua, 1);
+			table.append(std::move(element));
+		}
+
+		// The array part was read above; lua_next gives the other keys once.
+		lua_pushnil(m_lua);
+		while(read && lua_next(m_lua, index)) {
+			if(lua_isinteger(m_lua, -2)) {
+				lua_Integer const key = lua_tointeger(m_lua, -2);
+				if(key >= 1 && static_cast<lua_Unsigned>(key) <= arraySize) {
+					lua_pop(m_lua, 1);
+					continue;
+				}
+			}
+
+			Value key, value;
+			read = Read(-2, depth + 1, key) && Read(-1, depth + 1, value);
+			lua_pop(m_lua, 1);
+			if(read)
+				table.add(std::move(key), std::move(value));
+		}
+
+		lua_settop(m_lua, top);
+		m_path.pop_back();
+		if(read)
+			out = Value(std::move(table));
+		return read;
+	}
+};
+
+void PushValue(Lua::State& state, Value const& value) {
+	lua_State* s = state.GetState();
+	switch(value.storage().index()) {
+	case 0:
+		lua_pushnil(s);
+		break;
+	case 1:
+		lua_pushboolean(s, *value.get_if<bool>());
+		break;
+	case 2:
+		lua_pushinteger(s, *value.get_if<lua_Integer>());
+		break;
+	case 3:
+		lua_pushnumber(s, *value.get_if<lua_Number>());
+		break;
+	case 4:
+		{
+			SmallString const& str = *value.get_if<SmallString>();
+			lua_pushlstring(s, str.data(), str.size());
+			break;
+		}
+	case 5:
+		{
+			ValueTable const& table = *value.get_if<ValueTable>();
+			luaL_checkstack(s, 3, "Lua::Value is nested too deeply.");
+			lua_createtable(s, static_cast<int>(table.arraySize()), static_cast<int>(table.hashSize()));
+			for(std::size_t i = 0; i < table.arraySize(); ++i) {
+				PushValue(state, table.element(i));
+				lua_rawseti(s, -2, static_cast<lua_Integer>(i + 1));
+			}
+			for(std::size_t i = 0; i < table.hashSize(); ++i) {
+				Value const& key = table.key(i);
+				// Lua tables cannot hold these keys.
+				if(key.isNil())
+					continue;
+				if(lua_Number const* n = key.get_if<lua_Number>(); n && std::isnan(*n))
+					continue;
+				PushValue(state, key);
+				PushValue(state, table.value(i));
+				lua_rawset(s, -3);
+			}
+			break;
+		}
+	default:
+		state.luapp_push_reference(value.get_if<ValueReference>()->reference);
+		break;
+	}
+}
+}
+
+template <typename TEqual>
+std::size_t ValueTable::probe(std::size_t hash, TEqual const& equal) const {
+	std::size_t const count = hashSize();
+	if(m_index.empty()) {
+		for(std::size_t i = 0; i < count; ++i)
+			if(equal(key(i)))
+				return i;
+		return count;
+	}
+
+	std::size_t const mask = m_index.size() - 1;
+	for(std::size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+		std::uint32_t const entry = m_index[slot];
+		if(entry == 0)
+			return count;
+		if(equal(key(entry - 1)))
+			return entry - 1;
+	}
+}
+std::size_t ValueTable::findHash(Value const& key) const {
+	return probe(m_index.empty() ? 0 : HashKey(key), [&key](Value const& k) { return SameKey(k, key); });
+}
+void ValueTable::index(std::size_t entry) {
+	std::size_t const mask = m_index.size() - 1;
+	std::size_t slot       = HashKey(key(entry)) & mask;
+	while(m_index[slot] != 0)
+		slot = (slot + 1) & mask;
+	m_index[slot] = static_cast<std::uint32_t>(entry + 1);
+}
+void ValueTable::rehash(std::size_t capacity) {
+	m_index.assign(capacity, 0);
+	for(std::size_t i = 0, count = hashSize(); i < count; ++i)
+		index(i);
+}
+
+Value const* ValueTable::find(Value const& key) const {
+	Value const normalized = NormalizeKey(key);
+	if(lua_Integer const* i = normalized.get_if<lua_Integer>())
+		return find(*i);
+
+	std::size_t const position = findHash(normalized);
+	return position < hashSize() ? &value(position) : nullptr;
+}
+Value const* ValueTable::find(std::string_view key) const {
+	std::size_t const position = probe(m_index.empty() ? 0 : HashString(key), [key](Value const& k) {
+		SmallString const* str = k.get_if<SmallString>();
+		return str && str->view() == key;
+	});
+	return position < hashSize() ? &value(position) : nullptr;
+}
+Value const* ValueTable::find(lua_Integer key) const {
+	if(key >= 1 && static_cast<lua_Unsigned>(key) <= m_arraySize)
+		return &m_values[static_cast<std::size_t>(key - 1)];
+
+	std::size_t const position = probe(m_index.empty() ? 0 : HashInteger(key), [key](Value const& k) {
+		lua_Integer const* n = k.get_if<lua_Integer>();
+		return n && *n == key;
+	});
+	return position < hashSize() ? &value(position) : nullptr;
+}
+
+void ValueTable::reserve(std::size_t arraySize, std::size_t hashSize) {
+	m_values.reserve(arraySize + 2 * hashSize);
+	if(hashSize > LinearLimit && IndexCapacity(hashSize) > m_index.size())
+		rehash(IndexCapacity(hashSize));
+}
+void ValueTable::append(Value value) {
+	// The index refers to entries by position within the keys, so moving
+	// them all along leaves it valid.
+	m_values.insert(m_values.begin() + static_cast<std::ptrdiff_t>(m_arraySize), std::move(value));
+	++m_arraySize;
+}
+void ValueTable::set(Value key, Value value) {
+	key = NormalizeKey(key);
+	if(lua_Integer const* i = key.get_if<lua_Integer>()) {
+		if(*i >= 1 && static_cast<lua_Unsigned>(*i) <= m_arraySize) {
+			m_values[static_cast<std::size_t>(*i - 1)] = std::move(value);
+			return;
+		}
+	}
+
+	std::size_t const position = findHash(key);
+	if(position < hashSize())
+		m_values[m_arraySize + 2 * position + 1] = std::move(value);
+	else if(key.get_if<lua_Integer>() && *key.get_if<lua_Integer>() == static_cast<lua_Integer>(m_arraySize + 1))
+		append(std::move(value));
+	else
+		add(std::move(key), std::move(value));
+}
+void ValueTable::add(Value key, Value value) {
+	m_values.push_back(std::move(key));
+	m_values.push_back(std::move(value));
+
+	std::size_t const count = hashSize();
+	if(count <= LinearLimit)
+		return;
+	if(2 * count > m_index.size())
+		rehash(IndexCapacity(count));
+	else
+		index(count - 1);
+}
+
+bool ValueTable::operator==(ValueTable const& o) const {
+	if(m_arraySize + hashSize() != o.m_arraySize + o.hashSize())
+		return false;
+	for(std::size_t i = 0; i < m_arraySize; ++i) {
+		Value const* other = o.find(static_cast<lua_Integer>(i + 1));
+		if(!other || *other != element(i))
+			return false;
+	}
+	for(std::size_t i = 0, count = hashSize(); i < count; ++i) {
+		Value const* other = o.find(key(i));
+		if(!other || *other != value(i))
+			return false;
+	}
+	return true;
+}
+
+std::optional<Value> Value::Read(Lua::State& state, int index, std::size_t maxDepth) {
+	Value value;
+	if(!ValueReader(state, maxDepth).Read(index, 0, value))
+		return std::nullopt;
+	return value;
+}
+bool Value::Readable(Lua::State& state, int index, std::size_t maxDepth) {
+	return ValueReader(state, maxDepth).Check(index, 0);
+}
+void Value::push(Lua::State& state) const {
+	PushValue(state, *this);
+}
+
+Lua::Type Value::type() const noexcept {
+	switch(m_value.index()) {
+	case 0:
+		return TP_NIL;
+	case 1:
+		return TP_BOOL;
+	case 2:
+	case 3:
+		return TP_NUMBER;
+	case 4:
+		return TP_STRING;
+	case 5:
+		return TP_TABLE;
+	default:
+		return std::get_if<ValueReference>(&m_value)->type;
+	}
+}
+std::optional<lua_Number> Value::number() const noexcept {
+	if(lua_Integer const* i = get_if<lua_Integer>())
+		return static_cast<lua_Number>(*i);
+	if(lua_Number const* n = get_if<lua_Number>())
+		return *n;
+	return std::nullopt;
+}
+std::optional<std::string_view> Value::string() const noexcept {
+	if(SmallString const* str = get_if<SmallString>())
+		return str->view();
+	return std::nullopt;
+}
+bool Value::operator==(Value const& o) const {
+	if(m_value.index() != o.m_value.index()) {
+		if(!number() || !o.number())
+			return false;
+		// An integer and a number are equal when the number is integral.
+		Value const a = NormalizeKey(*this), b = NormalizeKey(o);
+		return a.m_value.index() == b.m_value.index() && a == b;
+	}
+
+	switch(m_value.index()) {
+	case 0:
+		return true;
+	case 1:
+		return *get_if<bool>() == *o.get_if<bool>();
+	case 2:
+		return *get_if<lua_Integer>() == *o.get_if<lua_Integer>();
+	case 3:
+		return *get_if<lua_Number>() == *o.get_if<lua_Number>();
+	case 4:
+		return *get_if<SmallString>() == *o.get_if<SmallString>();
+	case 5:
+		return *get_if<ValueTable>() == *o.get_if<ValueTable>();
+	default:
+		return *get_if<ValueReference>() == *o.get_if<ValueReference>();
+	}
+}
+Value const* Value::find(std::string_view key) const {
+	ValueTable const* table = get_if<ValueTable>();
+	return table ? table->find(key) : nullptr;
+}
+Value const* Value::find(lua_Integer key) const {
+	ValueTable const* table = get_if<ValueTable>();
+	return table ? table->find(key) : nullptr;
+}
+
+}
@@ -0,0 +1,63 @@
+#include "View.hpp"
+
+namespace Lua {
+
+namespace {
+// The view cells of a State are stored in the registry under this address,
+// in a table keyed by container address with weak values.
+char const viewCellsKey = 0;
+
+bool PushViewCells(lua_State* s, bool create) {
+	if(lua_rawgetp(s, LUA_REGISTRYINDEX, &viewCellsKey) == LUA_TTABLE)
+		return true;
+	lua_pop(s, 1);
+	if(!create)
+		return false;
+
+	lua_createtable(s, 0, 0);
+	lua_createtable(s, 0, 1);
+	lua_pushliteral(s, "v");
+	lua_setfield(s, -2, "__mode");
+	lua_setmetatable(s, -2);
+	lua_pushvalue(s, -1);
+	lua_rawsetp(s, LUA_REGISTRYINDEX, &viewCellsKey);
+	return true;
+}
+}
+
+namespace impl {
+void const* const* PushViewCell(lua_State* s, void const* container) {
+	PushViewCells(s, true);
+	if(lua_rawgetp(s, -1, container) == LUA_TUSERDATA) {
+		void const** cell = static_cast<void const**>(lua_touserdata(s, -1));
+		if(*cell) {
+			lua_remove(s, -2);
+			return cell;
+		}
+	}
+	lua_pop(s, 1);
+
+	// A container at the address of an invalidated one gets a new cell.
+	void const** cell = static_cast<void const**>(lua_newuserdatauv(s, sizeof(void const*), 0));
+	*cell             = container;
+	lua_pushvalue(s, -1);
+	lua_rawsetp(s, -3, container);
+	lua_remove(s, -2);
+	return cell;
+}
+}
+
+void State::luapp_invalidate_view(void const* container) {
+	lua_State* s = GetState();
+	if(!PushViewCells(s, false))
+		return;
+
+	if(lua_rawgetp(s, -1, container) == LUA_TUSERDATA)
+		*static_cast<void const**>(lua_touserdata(s, -1)) = nullptr;
+	lua_pop(s, 1);
+	lua_pushnil(s);
+	lua_rawsetp(s, -2, container);
+	lua_pop(s, 1);
+}
+
+}
@@ -0,0 +1,85 @@
+/*	Copyright (c) 2023 Mauro Grassia
+**	
+**	Permission is granted to use, modify and redistribute this software.
+**	Modified versions of this software MUST be marked as such.
+**	
+**	This software is provided "AS IS". In no event shall
+**	the authors or copyright holders be liable for any claim,
+**	damages or other liability. The above copyright notice
+**	and this permission notice shall be included in all copies
+**	or substantial portions of the software.
+**	
+*/
+
+#ifndef LUAPP_TEST_HPP
+#define LUAPP_TEST_HPP
+
+#include "LuaPP.hpp"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+
+/*	Every test is an executable that runs its checks and returns non-zero
+ *	when one of them failed. Scripts run through Test::Run, which reports
+ *	the Lua error instead of raising it.
+ */
+
+namespace Test {
+
+inline int& Failures() {
+	static int failures = 0;
+	return failures;
+}
+
+inline bool Check(bool condition, char const* expression, char const* file, int line, std::string const& detail = std::string()) {
+	if(!condition) {
+		++Failures();
+		std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+		if(!detail.empty())
+			std::fprintf(stderr, "\t%s\n", detail.c_str());
+	}
+	return condition;
+}
+
+// A new State with the standard libraries and the LuaPP metatables.
+inline std::shared_ptr<Lua::State> NewState() {
+	std::shared_ptr<Lua::State> state = Lua::StateManager::Get().Create();
+	state->openlibs();
+	state->luapp_register_metatables();
+	return state;
+}
+
+// Runs a chunk and returns its error message, or an empty string.
+inline std::string Run(Lua::State& state, char const* code) {
+	int const top = state.gettop();
+	std::string error;
+	if(state.loadstring(code) != LUA_OK || state.pcall(0, 0, 0) != LUA_OK)
+		error = state.tostdstring(-1);
+	state.settop(top);
+	return error;
+}
+
+inline int Result() {
+	if(Failures())
+		std::fprintf(stderr, "%d check(s) failed\n", Failures());
+	return Failures() ? 1 : 0;
+}
+
+}
+
+#define CHECK(...) Test::Check(static_cast<bool>(__VA_ARGS__), #__VA_ARGS__, __FILE__, __LINE__)
+// The chunk runs without errors; its assert() calls are checks too.
+#define CHECK_RUN(state, code) \
+	do { \
+		std::string const luapp_error = Test::Run(state, code); \
+		Test::Check(luapp_error.empty(), "Run(" #code ")", __FILE__, __LINE__, luapp_error); \
+	} while(false)
+// The chunk fails with an error message containing text.
+#define CHECK_ERROR(state, code, text) \
+	do { \
+		std::string const luapp_error = Test::Run(state, code); \
+		Test::Check(luapp_error.find(text) != std::string::npos, "Run(" #code ") raises \"" text "\"", __FILE__, __LINE__, luapp_error); \
+	} while(false)
+
+#endif
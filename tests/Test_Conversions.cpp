@@ -0,0 +1,112 @@
+#include "Test.hpp"
+
+#include <array>
+#include <set>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+
+struct Player {
+	std::string name;
+	int hp = 0;
+};
+
+template <>
+struct Lua::TypeConverter<Player> : Lua::StructConverter<Player> {
+	static constexpr auto fields() { return std::make_tuple(Lua::Field("name", &Player::name), Lua::Field("hp", &Player::hp)); }
+};
+
+static std::tuple<int, std::string> split(std::string text) {
+	return { static_cast<int>(text.size()), text.substr(0, 1) };
+}
+static std::pair<int, int> swapped(std::pair<int, int> values) {
+	return { values.second, values.first };
+}
+static int sumOf(std::array<int, 3> values) {
+	return values[0] + values[1] + values[2];
+}
+static Player heal(Player player) {
+	player.hp += 10;
+	return player;
+}
+
+static void TestContainers() {
+	auto state = Test::NewState();
+	state->luapp_add_translated_function("sumOf", Lua::Transform<&sumOf>());
+	state->luapp_add_translated_function("heal", Lua::Transform<&heal>());
+
+	CHECK_RUN(*state, "assert(sumOf({ 1, 2, 3 }) == 6)");
+	CHECK_ERROR(*state, "sumOf({ 1, 2 })", "argument #1");
+	CHECK_ERROR(*state, "sumOf({ 1, 2, 3, 4 })", "argument #1");
+	CHECK_ERROR(*state, "sumOf({ 1, 'x', 3 })", "argument #1");
+	CHECK_RUN(*state, "local p = heal({ name = 'ann', hp = 5 }) assert(p.name == 'ann' and p.hp == 15)");
+
+	std::unordered_map<std::string, int> const ages { { "ann", 31 }, { "bob", 42 } };
+	state->luapp_push_value(ages);
+	CHECK(state->luapp_get_value<std::unordered_map<std::string, int>>(-1) == ages);
+	state->pop(1);
+	std::set<int> const numbers { 3, 1, 2 };
+	state->luapp_push_value(numbers);
+	CHECK(state->luapp_get_value<std::set<int>>(-1) == numbers);
+	state->pop(1);
+}
+
+// Tuples and pairs are multiple values everywhere.
+static void TestMultipleValues() {
+	auto state = Test::NewState();
+	state->luapp_add_translated_function("split", Lua::Transform<&split>());
+	state->luapp_add_translated_function("swapped", Lua::Transform<&swapped>());
+
+	CHECK_RUN(*state, "local n, first = split('hello') assert(n == 5 and first == 'h')");
+	CHECK_RUN(*state, "local a, b = swapped(1, 2) assert(a == 2 and b == 1)");
+	CHECK_ERROR(*state, "swapped(1)", "argument #2");
+	CHECK_ERROR(*state, "swapped(1, 2, 3)", "Too many arguments");
+
+	CHECK(state->luapp_push_value(std::make_tuple(1, std::string("x"), 2.5)) == 3);
+	CHECK(state->gettop() == 3);
+	auto values = state->luapp_get_value<std::tuple<int, std::string, double>>(1);
+	CHECK(values && *values == std::make_tuple(1, std::string("x"), 2.5));
+	CHECK(!state->luapp_get_value<std::tuple<int, std::string, double, int>>(1));
+	state->settop(0);
+
+	CHECK_RUN(*state, "function pairOf(x) return x, -x end");
+	state->getglobal("pairOf");
+	Lua::LuaFunction<std::pair<int, int>(int)> pairOf(state->luapp_pop_reference());
+	CHECK(pairOf(4) == std::make_pair(4, -4));
+
+	// They cannot be stored in a table.
+	bool thrown = false;
+	try {
+		state->luapp_push_value(std::vector<std::pair<int, int>> { { 1, 2 } });
+	}
+	catch(Lua::lua_exception const&) {
+		thrown = true;
+	}
+	CHECK(thrown);
+	CHECK(state->gettop() == 0);
+}
+
+static int pickOne(int a) {
+	return a;
+}
+static int pickPair(std::pair<int, int> values) {
+	return values.first * values.second;
+}
+static int pickTuple(std::tuple<int, int, std::string> values) {
+	return static_cast<int>(std::get<2>(values).size());
+}
+
+static void TestOverloads() {
+	auto state = Test::NewState();
+	state->luapp_add_translated_function("pick", Lua::Overload(&pickOne, &pickPair, &pickTuple));
+	CHECK_RUN(*state, "assert(pick(3) == 3 and pick(3, 4) == 12 and pick(1, 2, 'abc') == 3)");
+	CHECK_ERROR(*state, "pick(1, 'x')", "No overload");
+}
+
+int main() {
+	TestContainers();
+	TestMultipleValues();
+	TestOverloads();
+	return Test::Result();
+}
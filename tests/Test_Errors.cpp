@@ -0,0 +1,83 @@
+#include "Test.hpp"
+
+#include <exception>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+// C++ exceptions become Lua errors once they have been handled, so that
+// no catch block is left by a longjmp.
+
+static bool throwOnFragile = false;
+
+struct Fragile {
+	Fragile() {
+		if(throwOnFragile)
+			throw std::runtime_error("cannot build");
+	}
+	~Fragile() noexcept(false) {
+		if(throwOnFragile)
+			throw std::runtime_error("cannot tear down");
+	}
+};
+
+template <>
+struct MetatableDescriptor<Fragile> {
+	static char const* name() { return "test_fragile_mt"; }
+	static char const* luaname() { return "Fragile"; }
+	static char const* constructor() { return "new"; }
+	static bool construct(Fragile* p) { return Lua::DefaultConstructor(p); }
+	static void metatable(Lua::member_function_storage<Fragile>& mt) {
+		mt["fail"] = std::function<int(Lua::State&)>([](Lua::State&) -> int { throw std::runtime_error("method failed"); });
+	}
+};
+
+static int Throwing(Lua::State&) {
+	throw std::runtime_error("plain failure");
+}
+
+// Nothing is left in a handler after the error reached Lua.
+static void CheckHandled(Lua::State& state, char const* code, char const* text) {
+	for(int i = 0; i < 100; ++i) {
+		std::string const error = Test::Run(state, code);
+		Test::Check(error.find(text) != std::string::npos, code, __FILE__, __LINE__, error);
+	}
+	CHECK(std::current_exception() == nullptr);
+	CHECK(std::uncaught_exceptions() == 0);
+	CHECK(state.gettop() == 0);
+}
+
+static void TestFunctions() {
+	auto state = Test::NewState();
+	state->luapp_add_translated_function("stored", std::function<int(Lua::State&)>(&Throwing));
+	state->luapp_add_translated_function("typed", [](Lua::State&) -> int { throw Lua::lua_exception("typed failure"); });
+	state->luapp_add_translated_function("unknown", [](Lua::State&) -> int { throw 42; });
+	state->luapp_register_library("errors", { { "fail", std::function<int(Lua::State&)>(&Throwing) } });
+
+	CheckHandled(*state, "stored()", "C++ Exception: plain failure");
+	CheckHandled(*state, "typed()", "C++ / Lua Exception: typed failure");
+	CheckHandled(*state, "unknown()", "Unknown C++ Exception thrown.");
+	CheckHandled(*state, "errors.fail()", "C++ Exception: plain failure");
+	CHECK_ERROR(*state, "stored()", "[string");
+}
+
+static void TestObjects() {
+	auto state = Test::NewState();
+	state->luapp_register_object<Fragile>();
+
+	CheckHandled(*state, "Fragile.new():fail()", "C++ Exception: method failed");
+
+	CHECK_RUN(*state, "fragiles = {} for i = 1, 100 do fragiles[i] = Fragile.new() end");
+	throwOnFragile = true;
+	CheckHandled(*state, "Fragile.new()", "C++ Exception thrown while constructing object test_fragile_mt.\ncannot build");
+	// Each object is destroyed once, then detached from its metatable.
+	CheckHandled(*state, "local f = table.remove(fragiles) local _, e = pcall(getmetatable(f).__gc, f) debug.setmetatable(f, nil) error(e, 0)",
+		"C++ Exception thrown while destructing object test_fragile_mt.\ncannot tear down");
+	throwOnFragile = false;
+}
+
+int main() {
+	TestFunctions();
+	TestObjects();
+	return Test::Result();
+}
@@ -0,0 +1,94 @@
+#include "Test.hpp"
+
+#include <iterator>
+#include <string>
+#include <tuple>
+#include <vector>
+
+static Lua::ReferenceType ReadGlobal(Lua::State& state, char const* name) {
+	state.getglobal(name);
+	return state.luapp_pop_reference();
+}
+
+static void TestLuaFunction() {
+	auto state = Test::NewState();
+	CHECK_RUN(*state, "function twice(x) return 2 * x end function split(s) return s:sub(1, 1), #s end");
+
+	Lua::LuaFunction<int(int)> twice(ReadGlobal(*state, "twice"));
+	CHECK(twice(21) == 42);
+	CHECK(twice.call(*state, 4) == 8);
+
+	Lua::LuaFunction<std::tuple<std::string, int>(std::string)> split(ReadGlobal(*state, "split"));
+	CHECK(split("hello") == std::make_tuple(std::string("h"), 5));
+	CHECK(state->gettop() == 0);
+}
+
+// Each element of a tuple argument takes a stack slot, beyond the
+// LUA_MINSTACK slots that Lua guarantees.
+static void TestTupleArguments() {
+	auto state = Test::NewState();
+	CHECK_RUN(*state, "function count(...) return select('#', ...) end");
+
+	Lua::LuaFunction<int(std::tuple<int, int, int, int, int, int, int, int, int, int>, std::tuple<int, int, int, int, int, int, int, int, int, int>,
+	                     std::tuple<int, int, int, int, int, int, int, int, int, int>)>
+		count(ReadGlobal(*state, "count"));
+	auto const ten = std::make_tuple(1, 2, 3, 4, 5, 6, 7, 8, 9, 10);
+	CHECK(count(ten, ten, ten) == 30);
+	CHECK(state->gettop() == 0);
+}
+
+// A function is only called on the State whose registry holds it.
+static void TestForeignState() {
+	auto state = Test::NewState();
+	auto other = Test::NewState();
+	CHECK_RUN(*state, "function twice(x) return 2 * x end");
+	CHECK_RUN(*other, "function other() return 0 end");
+
+	Lua::LuaFunction<int(int)> twice(ReadGlobal(*state, "twice"));
+	bool thrown = false;
+	try {
+		twice.call(*other, 1);
+	}
+	catch(Lua::lua_exception&) {
+		thrown = true;
+	}
+	CHECK(thrown);
+	CHECK(other->gettop() == 0);
+	CHECK(twice(1) == 2);
+}
+
+static void TestBatch() {
+	auto state = Test::NewState();
+	auto other = Test::NewState();
+	CHECK_RUN(*state, "function add(a, b) return a + b end");
+	Lua::ReferenceType add = ReadGlobal(*state, "add");
+
+	std::vector<std::tuple<int, int>> const pairs = { { 1, 2 }, { 3, 4 }, { 5, 6 } };
+	std::vector<int> sums;
+	state->luapp_call_batch<int>(add, pairs.begin(), pairs.end(), std::back_inserter(sums));
+	CHECK(sums == std::vector<int>({ 3, 7, 11 }));
+
+	std::vector<int> const a = { 1, 2 }, b = { 10, 20 };
+	sums.clear();
+	state->luapp_call_batch_columns<int>(add, 2, std::back_inserter(sums), a, b);
+	CHECK(sums == std::vector<int>({ 11, 22 }));
+	CHECK(state->gettop() == 0);
+
+	bool thrown = false;
+	try {
+		other->luapp_call_batch<int>(add, pairs.begin(), pairs.end(), std::back_inserter(sums));
+	}
+	catch(Lua::lua_exception&) {
+		thrown = true;
+	}
+	CHECK(thrown);
+	CHECK(other->gettop() == 0);
+}
+
+int main() {
+	TestLuaFunction();
+	TestTupleArguments();
+	TestForeignState();
+	TestBatch();
+	return Test::Result();
+}
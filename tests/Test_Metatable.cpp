@@ -0,0 +1,533 @@
+#include "Test.hpp"
+
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+struct Shape {
+	int sides = 0;
+	int color = 1;
+	int getSides() const { return sides; }
+};
+struct Square : Shape {
+	Square() { sides = 4; }
+	int area() const { return 4; }
+};
+struct Labeled {
+	std::string label = "none";
+};
+// Labeled comes first, so reaching Shape moves the pointer.
+struct Cube : Labeled, Square {
+	int depth = 4;
+};
+struct Point {
+	int x = 0;
+};
+struct Entity {
+	double x = 0;
+	std::string name;
+	int id = 7;
+	int const kind = 3;
+	int aVeryLongPropertyNameThatLuaDoesNotInternAsAShortString = 5;
+};
+struct Vec2 {
+	static int closed;
+	double x = 0, y = 0;
+	std::size_t size() const { return 2; }
+	void close() { ++closed; }
+};
+int Vec2::closed = 0;
+static Vec2 operator+(Vec2 const& a, Vec2 const& b) {
+	return { a.x + b.x, a.y + b.y };
+}
+static Vec2 operator*(Vec2 const& a, double k) {
+	return { a.x * k, a.y * k };
+}
+static Vec2 operator*(double k, Vec2 const& a) {
+	return a * k;
+}
+static Vec2 operator-(Vec2 const& a) {
+	return { -a.x, -a.y };
+}
+static bool operator==(Vec2 const& a, Vec2 const& b) {
+	return a.x == b.x && a.y == b.y;
+}
+static bool operator<(Vec2 const& a, Vec2 const& b) {
+	return a.x * a.x + a.y * a.y < b.x * b.x + b.y * b.y;
+}
+static std::ostream& operator<<(std::ostream& stream, Vec2 const& v) {
+	return stream << '(' << v.x << ", " << v.y << ')';
+}
+struct Stack {
+	std::vector<int> items;
+	void push(int value) { items.push_back(value); }
+	int pop() {
+		int const value = items.back();
+		items.pop_back();
+		return value;
+	}
+	std::size_t count() const { return items.size(); }
+};
+struct Lazy {
+	int get() const { return 42; }
+};
+struct Tracked {
+	static int destroyed;
+	~Tracked() { ++destroyed; }
+};
+int Tracked::destroyed = 0;
+struct Counter {
+	int value = 0;
+	int next() { return ++value; }
+};
+
+template <>
+struct MetatableDescriptor<Shape> {
+	static char const* name() { return "test_shape_mt"; }
+	static char const* luaname() { return "Shape"; }
+	static char const* constructor() { return "new"; }
+	static bool construct(Shape* p) { return Lua::DefaultConstructor(p); }
+	static void metatable(Lua::member_function_storage<Shape>& mt) {
+		mt["sides"] = Lua::Bind<&Shape::getSides>();
+		mt.property("color", &Shape::color);
+	}
+};
+template <>
+struct MetatableDescriptor<Square> {
+	typedef std::tuple<Shape> bases;
+	static char const* name() { return "test_square_mt"; }
+	static char const* luaname() { return "Square"; }
+	static char const* constructor() { return "new"; }
+	static bool construct(Square* p) { return Lua::DefaultConstructor(p); }
+	static void metatable(Lua::member_function_storage<Square>& mt) { mt["area"] = Lua::Bind<&Square::area>(); }
+};
+template <>
+struct MetatableDescriptor<Labeled> {
+	static char const* name() { return "test_labeled_mt"; }
+	static char const* luaname() { return "Labeled"; }
+	static char const* constructor() { return ""; }
+	static bool construct(Labeled* p) { return Lua::DefaultConstructor(p); }
+	static void metatable(Lua::member_function_storage<Labeled>& mt) { mt.property("label", &Labeled::label); }
+};
+template <>
+struct MetatableDescriptor<Cube> {
+	typedef std::tuple<Square, Labeled> bases;
+	static char const* name() { return "test_cube_mt"; }
+	static char const* luaname() { return "Cube"; }
+	static char const* constructor() { return "new"; }
+	static bool construct(Cube* p) { return Lua::DefaultConstructor(p); }
+	static void metatable(Lua::member_function_storage<Cube>& mt) { mt.property("depth", &Cube::depth); }
+};
+template <>
+struct MetatableDescriptor<Point> {
+	static char const* name() { return "test_point_mt"; }
+	static char const* luaname() { return "Point"; }
+	static char const* constructor() { return "new"; }
+	static bool construct(Point* p) { return Lua::DefaultConstructor(p); }
+};
+
+template <>
+struct MetatableDescriptor<Counter> {
+	static char const* name() { return "test_counter_mt"; }
+	static char const* luaname() { return "Counter"; }
+	static char const* constructor() { return "new"; }
+	static bool construct(Counter* p) { return Lua::DefaultConstructor(p); }
+	static constexpr bool direct_index = true;
+	static void metatable(Lua::member_function_storage<Counter>& mt) {
+		mt["next"] = Lua::Bind<&Counter::next>();
+		// Metamethods may also be std::functions.
+		mt["__call"] = Lua::Transform(std::function<int(Counter*, int)>([](Counter* c, int step) { return c->value += step; }));
+	}
+};
+
+template <>
+struct MetatableDescriptor<Entity> {
+	static char const* name() { return "test_entity_mt"; }
+	static char const* luaname() { return "Entity"; }
+	static char const* constructor() { return "new"; }
+	static bool construct(Entity* p) { return Lua::DefaultConstructor(p); }
+	static void metatable(Lua::member_function_storage<Entity>& mt) {
+		mt.property("x", &Entity::x).property("name", &Entity::name).property("id", &Entity::id, true).property("kind", &Entity::kind);
+		mt.property("aVeryLongPropertyNameThatLuaDoesNotInternAsAShortString", &Entity::aVeryLongPropertyNameThatLuaDoesNotInternAsAShortString);
+	}
+};
+
+template <>
+struct MetatableDescriptor<Vec2> {
+	static char const* name() { return "test_vec2_mt"; }
+	static char const* luaname() { return "Vec2"; }
+	static char const* constructor() { return "new"; }
+	static bool construct(Vec2* p) { return Lua::DefaultConstructor(p); }
+	static void metatable(Lua::member_function_storage<Vec2>& mt) {
+		mt.property("x", &Vec2::x).property("y", &Vec2::y);
+		mt.arithmetic<Lua::OP_ADD>().arithmetic<Lua::OP_MUL, double>().arithmetic<Lua::OP_UNM>();
+		mt.comparison<Lua::IS_EQUAL>().comparison<Lua::IS_LESS_THAN>();
+		mt.length().tostring().close<&Vec2::close>();
+	}
+};
+
+template <>
+struct MetatableDescriptor<Tracked> {
+	static char const* name() { return "test_tracked_mt"; }
+	static char const* luaname() { return "Tracked"; }
+	static char const* constructor() { return "new"; }
+	static bool construct(Tracked* p) { return Lua::DefaultConstructor(p); }
+};
+
+// Methods from a constant table only.
+template <>
+struct MetatableDescriptor<Stack> {
+	static char const* name() { return "test_stack_mt"; }
+	static char const* luaname() { return "Stack"; }
+	static char const* constructor() { return "new"; }
+	static bool construct(Stack* p) { return Lua::DefaultConstructor(p); }
+	static constexpr luaL_Reg methods[] = {
+		{ "push", Lua::Bind<&Stack::push>() },
+		{ "pop", Lua::Bind<&Stack::pop>() },
+		{ "count", Lua::Bind<&Stack::count>() },
+		{ nullptr, nullptr }
+	};
+};
+// Methods from a constant table and from a metatable function.
+struct LimitedStack {
+	std::vector<int> items;
+	int limit = 3;
+	void push(int value) { items.push_back(value); }
+	std::size_t count() const { return items.size(); }
+};
+template <>
+struct MetatableDescriptor<LimitedStack> {
+	static char const* name() { return "test_limited_stack_mt"; }
+	static char const* luaname() { return "LimitedStack"; }
+	static char const* constructor() { return "new"; }
+	static bool construct(LimitedStack* p) { return Lua::DefaultConstructor(p); }
+	static constexpr luaL_Reg methods[] = {
+		{ "push", Lua::Bind<&LimitedStack::push>() },
+		{ nullptr, nullptr }
+	};
+	static void metatable(Lua::member_function_storage<LimitedStack>& mt) {
+		mt["count"] = Lua::Bind<&LimitedStack::count>();
+		mt.property("limit", &LimitedStack::limit);
+	}
+};
+
+template <>
+struct MetatableDescriptor<Lazy> {
+	static char const* name() { return "test_lazy_mt"; }
+	static char const* luaname() { return "Lazy"; }
+	static char const* constructor() { return "new"; }
+	static bool construct(Lazy* p) { return Lua::DefaultConstructor(p); }
+	static void metatable(Lua::member_function_storage<Lazy>& mt) { mt["get"] = Lua::Bind<&Lazy::get>(); }
+};
+
+static int sidesOf(Shape* shape) {
+	return shape->sides;
+}
+
+static void Register(Lua::State& state) {
+	state.luapp_register_object<Shape>();
+	state.luapp_register_object<Square>();
+	state.luapp_register_object<Point>();
+	state.luapp_add_translated_function("sidesOf", Lua::Transform<&sidesOf>());
+}
+
+static void TestTypeChecks() {
+	auto state = Test::NewState();
+	Register(*state);
+
+	CHECK_RUN(*state, "local s = Square.new() assert(s:area() == 4 and s:sides() == 4 and sidesOf(s) == 4)");
+	CHECK_RUN(*state, "assert(sidesOf(Shape.new()) == 0)");
+	CHECK_ERROR(*state, "sidesOf(Point.new())", "argument #1");
+	CHECK_ERROR(*state, "sidesOf(io.stdout)", "argument #1");
+	CHECK_ERROR(*state, "Square.new().area(Shape.new())", "test_square_mt");
+	CHECK_ERROR(*state, "Square.new().area(io.stdout)", "test_square_mt");
+
+	state->luapp_push_object<Square>();
+	CHECK(state->luapp_get_object<Shape>(-1) != nullptr);
+	CHECK(state->luapp_get_object<Square>(-1)->area() == 4);
+	state->pop(1);
+	state->luapp_push_shared(std::make_shared<Point>());
+	CHECK(state->luapp_get_shared<Point>(-1) != nullptr);
+	state->pop(1);
+}
+
+static std::string labelOf(Labeled* labeled) {
+	return labeled->label;
+}
+
+// Cube reaches Shape through Square, and Labeled directly.
+static void TestInheritance() {
+	auto state = Test::NewState();
+	Register(*state);
+	state->luapp_register_object<Labeled>();
+	state->luapp_register_object<Cube>();
+	state->luapp_add_translated_function("labelOf", Lua::Transform<&labelOf>());
+
+	CHECK_RUN(*state, R"(
+		local c = Cube.new()
+		assert(c:sides() == 4 and c:area() == 4 and sidesOf(c) == 4 and labelOf(c) == 'none')
+		assert(c.color == 1 and c.label == 'none' and c.depth == 4)
+		c.color, c.label, c.depth = 5, 'box', 6
+		assert(c.color == 5 and c.label == 'box' and c.depth == 6 and labelOf(c) == 'box')
+		assert(Square.new().color == 1 and Square.new().label == nil)
+	)");
+	CHECK_ERROR(*state, "labelOf(Square.new())", "argument #1");
+	CHECK_ERROR(*state, "Square.new().label = 'x'", "has no property 'label'");
+
+	Cube* cube = state->luapp_push_object<Cube>();
+	cube->color = 8;
+	cube->label = "pushed";
+	Shape* shape = state->luapp_get_object<Shape>(-1);
+	Labeled* labeled = state->luapp_get_object<Labeled>(-1);
+	CHECK(shape == static_cast<Shape*>(cube) && shape->color == 8);
+	CHECK(labeled == static_cast<Labeled*>(cube) && labeled->label == "pushed");
+	CHECK(state->luapp_get_object<Square>(-1) == static_cast<Square*>(cube));
+	state->pop(1);
+}
+
+static bool HasMetatable(Lua::State& state, char const* name) {
+	bool const found = luaL_getmetatable(state.GetState(), name) != LUA_TNIL;
+	state.pop(1);
+	return found;
+}
+
+// The metatable is built on first use, from Lua or from C++.
+static void TestLazyRegistration() {
+	auto state = Test::NewState();
+	state->luapp_register_object_lazy<Lazy>();
+	CHECK(!HasMetatable(*state, "test_lazy_mt"));
+
+	// The global is a placeholder that fills itself in place.
+	CHECK_RUN(*state, "saved = Lazy assert(type(Lazy) == 'table' and rawget(Lazy, 'new') == nil)");
+	CHECK(!HasMetatable(*state, "test_lazy_mt"));
+	CHECK_RUN(*state, R"(
+		local object = Lazy.new()
+		assert(object:get() == 42 and saved == Lazy and rawget(Lazy, 'new') ~= nil)
+		assert(getmetatable(Lazy) == nil and package.loaded.Lazy == Lazy)
+	)");
+	CHECK(HasMetatable(*state, "test_lazy_mt"));
+
+	auto other = Test::NewState();
+	other->luapp_register_object_lazy<Lazy>();
+	CHECK(!HasMetatable(*other, "test_lazy_mt"));
+	other->luapp_push_object<Lazy>();
+	CHECK(HasMetatable(*other, "test_lazy_mt"));
+	other->setglobal("pushed");
+	CHECK_RUN(*other, "assert(pushed:get() == 42 and getmetatable(pushed) == getmetatable(Lazy.new()))");
+}
+
+// Every State checks against its own metatables.
+static void TestSeveralStates() {
+	auto first  = Test::NewState();
+	auto second = Test::NewState();
+	Register(*first);
+	Register(*second);
+
+	for(auto* state : { first.get(), second.get() }) {
+		CHECK_RUN(*state, "assert(sidesOf(Square.new()) == 4)");
+		CHECK_ERROR(*state, "sidesOf(Point.new())", "argument #1");
+	}
+}
+
+// Methods are found in their own table, where metamethods are not.
+static void TestMethodLookup() {
+	auto state = Test::NewState();
+	Register(*state);
+	state->luapp_register_object<Counter>();
+
+	// With direct_index, __index is the methods table itself.
+	CHECK_RUN(*state, R"(
+		local c = Counter.new()
+		assert(c:next() == 1 and c:next() == 2)
+		assert(type(getmetatable(c).__index) == 'table' and getmetatable(c).__index.next == c.next)
+		assert(c.__gc == nil and c.__index == nil and c.__name == nil and c.missing == nil)
+		assert(c(10) == 12 and c.__call == nil)
+	)");
+	CHECK_RUN(*state, R"(
+		local s = Square.new()
+		assert(type(getmetatable(s).__index) == 'function' and s.area ~= nil)
+		assert(s.__gc == nil and s.__index == nil and s.missing == nil)
+	)");
+	CHECK_ERROR(*state, "Counter.new():missing()", "missing");
+}
+
+static void TestConstantMethods() {
+	auto state = Test::NewState();
+	state->luapp_register_object<Stack>();
+	state->luapp_register_object<LimitedStack>();
+
+	CHECK_RUN(*state, R"(
+		local s = Stack.new()
+		s:push(1) s:push(2)
+		assert(s:count() == 2 and s:pop() == 2 and s:count() == 1)
+		assert(s.limit == nil and s.__gc == nil)
+		local l = LimitedStack.new()
+		l:push(5)
+		assert(l:count() == 1 and l.limit == 3 and l.pop == nil)
+		l.limit = 4
+		assert(l.limit == 4)
+	)");
+	CHECK_ERROR(*state, "Stack.new().push(LimitedStack.new(), 1)", "test_stack_mt");
+}
+
+static void TestProperties() {
+	auto state = Test::NewState();
+	state->luapp_register_object<Entity>();
+
+	CHECK_RUN(*state, R"(
+		e = Entity.new()
+		assert(e.x == 0 and e.name == '' and e.id == 7 and e.kind == 3)
+		e.x, e.name = 2.5, 'box'
+		assert(e.x == 2.5 and e.name == 'box' and e.missing == nil and e[1] == nil)
+		local long = 'aVeryLongPropertyNameThatLuaDoesNotInternAsAShortString'
+		assert(e[long] == 5)
+		e[long] = 6
+		assert(e[long] == 6)
+	)");
+	state->getglobal("e");
+	Entity* entity = state->luapp_get_object<Entity>(-1);
+	CHECK(entity && entity->x == 2.5 && entity->name == "box" && entity->aVeryLongPropertyNameThatLuaDoesNotInternAsAShortString == 6);
+	state->pop(1);
+
+	CHECK_ERROR(*state, "e.id = 1", "Property 'id' of test_entity_mt is read-only.");
+	CHECK_ERROR(*state, "e.kind = 1", "Property 'kind' of test_entity_mt is read-only.");
+	CHECK_ERROR(*state, "e.x = 'far'", "cannot be set to a string value");
+	CHECK_ERROR(*state, "e.missing = 1", "test_entity_mt has no property 'missing'.");
+	CHECK_RUN(*state, "assert(e.id == 7 and e.x == 2.5)");
+}
+
+// The perfect hash finds interned names by address, the others by content.
+static void TestPropertyIndex() {
+	auto state = Test::NewState();
+	lua_State* L = state->GetState();
+
+	std::vector<std::string> names;
+	for(int i = 0; i < 50; ++i)
+		names.push_back("property" + std::to_string(i));
+	names.push_back(std::string(60, 'p'));
+	std::vector<std::string_view> views(names.begin(), names.end());
+	Lua::impl::PropertyIndex const* index = Lua::impl::PropertyIndex::Push(L, views);
+
+	bool found = true;
+	for(std::size_t i = 0; i < names.size(); ++i) {
+		state->pushstdstring(names[i]);
+		found = found && index->Find(L, -1) == static_cast<int>(i);
+		state->pop(1);
+	}
+	CHECK(found);
+
+	state->pushstdstring("property50");
+	state->pushstdstring(std::string(61, 'p'));
+	state->pushinteger(1);
+	CHECK(index->Find(L, -3) == -1 && index->Find(L, -2) == -1 && index->Find(L, -1) == -1);
+	state->settop(0);
+
+	// An index without names finds nothing.
+	Lua::impl::PropertyIndex const* empty = Lua::impl::PropertyIndex::Push(L, {});
+	state->pushstdstring("property0");
+	CHECK(empty->Find(L, -1) == -1);
+	state->settop(0);
+}
+
+static void TestOperators() {
+	auto state = Test::NewState();
+	state->luapp_register_object<Vec2>();
+	state->luapp_register_object<Point>();
+
+	CHECK_RUN(*state, R"(
+		function vec(x, y) local v = Vec2.new() v.x, v.y = x, y return v end
+		local a, b = vec(1, 2), vec(3, 4)
+		local sum = a + b
+		assert(getmetatable(sum) == getmetatable(a) and sum.x == 4 and sum.y == 6)
+		local scaled, scaledLeft = a * 3, 2 * a
+		assert(scaled.x == 3 and scaled.y == 6 and scaledLeft.x == 2 and scaledLeft.y == 4)
+		local negated = -a
+		assert(negated.x == -1 and negated.y == -2)
+		assert(a == vec(1, 2) and a ~= b and a < b and not (b < a))
+		assert(#a == 2 and tostring(a) == '(1, 2)')
+	)");
+	CHECK(state->gettop() == 0);
+
+	// Operands of other types are refused, except for equality.
+	CHECK_ERROR(*state, "return vec(1, 2) + 1", "Invalid operands for __add");
+	CHECK_ERROR(*state, "return vec(1, 2) * 'x'", "Invalid operands for __mul");
+	CHECK_ERROR(*state, "return vec(1, 2) < Point.new()", "Invalid operands for __lt");
+	CHECK_RUN(*state, "assert(vec(0, 0) ~= Point.new())");
+
+	Vec2::closed = 0;
+	CHECK_RUN(*state, "do local v <close> = vec(1, 1) end");
+	CHECK(Vec2::closed == 1);
+}
+
+// Objects owned by C++ map to one userdata while it lives.
+static void TestBorrowedAndShared() {
+	auto state = Test::NewState();
+	lua_State* L = state->GetState();
+	state->luapp_register_object<Tracked>();
+	state->luapp_register_object<Point>();
+
+	Tracked::destroyed = 0;
+	{
+		Tracked tracked;
+		CHECK(state->luapp_push_borrowed(&tracked) == &tracked);
+		state->luapp_push_borrowed(&tracked);
+		CHECK(lua_rawequal(L, -1, -2) && state->luapp_get_object<Tracked>(-1) == &tracked);
+		CHECK(!state->luapp_get_shared<Tracked>(-1));
+		state->settop(0);
+
+		// Collecting the userdata leaves the object alone.
+		lua_gc(L, LUA_GCCOLLECT, 0);
+		CHECK(Tracked::destroyed == 0);
+		state->luapp_push_borrowed(&tracked);
+		CHECK(state->luapp_get_object<Tracked>(-1) == &tracked);
+		state->settop(0);
+		lua_gc(L, LUA_GCCOLLECT, 0);
+		CHECK(Tracked::destroyed == 0);
+	}
+	CHECK(Tracked::destroyed == 1);
+
+	auto point = std::make_shared<Point>();
+	state->luapp_push_shared(point);
+	CHECK(point.use_count() == 2);
+	state->luapp_push_shared(point);
+	CHECK(lua_rawequal(L, -1, -2) && point.use_count() == 2);
+	CHECK(state->luapp_get_shared<Point>(-1) == point);
+	state->settop(0);
+	lua_gc(L, LUA_GCCOLLECT, 0);
+	CHECK(point.use_count() == 1);
+
+	// A borrowed userdata of the object is not reused to share it.
+	state->luapp_push_borrowed(point.get());
+	state->luapp_push_shared(point);
+	CHECK(!lua_rawequal(L, -1, -2) && state->luapp_get_shared<Point>(-1) == point && !state->luapp_get_shared<Point>(-2));
+	state->settop(0);
+	lua_gc(L, LUA_GCCOLLECT, 0);
+	CHECK(point.use_count() == 1);
+}
+
+// Functors check their argument against the metatable in their upvalue.
+static void TestFunctorCheck() {
+	auto state = Test::NewState();
+	state->luapp_add_translated_function("functor", std::function<int(Lua::State&)>([](Lua::State&) -> int { return 0; }));
+	CHECK_RUN(*state, "functor() functor(1, 2)");
+	CHECK_ERROR(*state, "getmetatable(functor).__call(io.stdout)", "luapp_functor");
+	CHECK_RUN(*state, "getmetatable(functor).__gc(io.stdout)");
+}
+
+int main() {
+	TestTypeChecks();
+	TestInheritance();
+	TestLazyRegistration();
+	TestSeveralStates();
+	TestMethodLookup();
+	TestConstantMethods();
+	TestProperties();
+	TestPropertyIndex();
+	TestOperators();
+	TestBorrowedAndShared();
+	TestFunctorCheck();
+	return Test::Result();
+}
@@ -0,0 +1,60 @@
+#include "Test.hpp"
+
+#include <cstdint>
+#include <vector>
+
+static void TestElements() {
+	auto state = Test::NewState();
+	state->luapp_register_object<Lua::NumericArray<double>>();
+	state->luapp_register_object<Lua::NumericArray<std::int32_t>>();
+
+	state->luapp_move_object(Lua::NumericArray<double>(std::vector<double>{ 1, 2, 3, 4, 5 }));
+	state->setglobal("samples");
+	CHECK_RUN(*state, "assert(#samples == 5 and samples:size() == 5) assert(samples[1] == 1 and samples[5] == 5)");
+	CHECK_RUN(*state, "assert(samples[0] == nil and samples[6] == nil and samples.x == nil)");
+	CHECK_RUN(*state, "samples[2] = 20 assert(samples[2] == 20)");
+	CHECK_ERROR(*state, "samples[6] = 1", "out of range");
+	CHECK_ERROR(*state, "samples[1] = 'x'", "cannot be set");
+
+	CHECK_RUN(*state, "local a = Int32Array.new() a:resize(3) a:fill(7) assert(a:sum() == 21 and a:min() == 7 and a:max() == 7)");
+	CHECK_RUN(*state, "assert(Int32Array.new():min() == nil)");
+	CHECK_ERROR(*state, "Int32Array.new():resize(-1)", "negative size");
+}
+
+static void TestKernels() {
+	auto state = Test::NewState();
+	state->luapp_register_object<Lua::NumericArray<double>>();
+
+	CHECK_RUN(*state, "x = DoubleArray.new() x:resize(9) for i = 1, 9 do x[i] = i end");
+	CHECK_RUN(*state, "assert(x:sum() == 45 and x:dot(x) == 285)");
+	CHECK_RUN(*state, "local y = DoubleArray.new() y:resize(9) y:axpy(2, x) y:scale(0.5) assert(y:dot(x) == 285)");
+	CHECK_ERROR(*state, "local y = DoubleArray.new() y:resize(2) y:axpy(1, x)", "different sizes");
+
+	state->getglobal("x");
+	Lua::NumericArray<double>* x = state->luapp_get_object<Lua::NumericArray<double>>(-1);
+	CHECK(x && x->size() == 9 && (*x)[8] == 9);
+	state->pop(1);
+}
+
+static void TestMap() {
+	auto state = Test::NewState();
+	state->luapp_register_object<Lua::NumericArray<double>>();
+
+	CHECK_RUN(*state, "x = DoubleArray.new() x:resize(4) for i = 1, 4 do x[i] = i end");
+	CHECK_RUN(*state, "local y = x:map(function(v) return v * v end) assert(#y == 4 and y[4] == 16 and y:sum() == 30)");
+	CHECK_ERROR(*state, "x:map(function(v) return 'x' end)", "expects numbers");
+	CHECK_ERROR(*state, "x:map(1)", "function expected");
+
+	// The function may resize the array it maps.
+	CHECK_ERROR(*state, "x:map(function(v) x:resize(0) return v end)", "shrank the array");
+	CHECK_RUN(*state, "assert(#x == 0)");
+	CHECK_RUN(*state, "x:resize(2) local y = x:map(function(v) x:resize(1000) return v + 1 end) assert(#y == 2 and #x == 1000)");
+	CHECK(state->gettop() == 0);
+}
+
+int main() {
+	TestElements();
+	TestKernels();
+	TestMap();
+	return Test::Result();
+}
@@ -0,0 +1,70 @@
+#include "Test.hpp"
+
+// Pooled bound types keep their objects in a pool owned by each State.
+
+static int destroyed = 0;
+
+struct Body {
+	double mass = 1;
+	~Body() { ++destroyed; }
+	double getMass() const { return mass; }
+};
+
+template <>
+struct MetatableDescriptor<Body> {
+	static constexpr bool pooled = true;
+	static char const* name() { return "test_body_mt"; }
+	static char const* luaname() { return "Body"; }
+	static char const* constructor() { return "new"; }
+	static bool construct(Body* p) { return Lua::DefaultConstructor(p); }
+	static void metatable(Lua::member_function_storage<Body>& mt) { mt["mass"] = Lua::Bind<&Body::getMass>(); }
+};
+
+static void TestReuse() {
+	auto state = Test::NewState();
+	state->luapp_register_object<Body>();
+
+	CHECK_RUN(*state, "bodies = {} for i = 1, 1000 do bodies[i] = Body.new() end assert(bodies[1000]:mass() == 1)");
+	Lua::PoolStatistics statistics = Lua::GetPoolStatistics<Body>(*state);
+	CHECK(statistics.live == 1000);
+	CHECK(statistics.allocations == 1000);
+	CHECK(statistics.capacity >= 1000);
+	std::size_t const slabs = statistics.slabs;
+
+	// Released slots are reused, and empty slabs are freed but one.
+	CHECK_RUN(*state, "bodies = nil collectgarbage()");
+	statistics = Lua::GetPoolStatistics<Body>(*state);
+	CHECK(statistics.live == 0);
+	CHECK(statistics.slabs == 1);
+	CHECK(destroyed == 1000);
+	CHECK_RUN(*state, "for i = 1, 1000 do Body.new() end collectgarbage()");
+	statistics = Lua::GetPoolStatistics<Body>(*state);
+	CHECK(statistics.allocations == 2000);
+	CHECK(statistics.slabs <= slabs);
+}
+
+// Each State has its own pool, which close() frees with the objects in it.
+static void TestPerState() {
+	auto first  = Test::NewState();
+	auto second = Test::NewState();
+	first->luapp_register_object<Body>();
+	second->luapp_register_object<Body>();
+
+	destroyed = 0;
+	CHECK_RUN(*first, "kept = { Body.new(), Body.new() }");
+	CHECK_RUN(*second, "kept = Body.new()");
+	CHECK(Lua::GetPoolStatistics<Body>(*first).live == 2);
+	CHECK(Lua::GetPoolStatistics<Body>(*second).live == 1);
+
+	first->close();
+	CHECK(destroyed == 2);
+	CHECK(Lua::GetPoolStatistics<Body>(*first).slabs == 0);
+	CHECK(Lua::GetPoolStatistics<Body>(*second).live == 1);
+	CHECK_RUN(*second, "assert(kept:mass() == 1)");
+}
+
+int main() {
+	TestReuse();
+	TestPerState();
+	return Test::Result();
+}
@@ -0,0 +1,130 @@
+#include "Test.hpp"
+
+#include <thread>
+#include <utility>
+
+static Lua::Ref PopTable(Lua::State& state, char const* code) {
+	state.loadstring(code);
+	state.pcall(0, 1, 0);
+	return state.luapp_pop_ref();
+}
+
+static void TestValues() {
+	auto state = Test::NewState();
+	Lua::Ref ref = PopTable(*state, "return { name = 'ref' }");
+	CHECK(ref && ref.state() == state->GetState());
+
+	Lua::Ref copy = ref;
+	CHECK(copy && copy.key() != ref.key());
+	Lua::Ref moved = std::move(ref);
+	CHECK(!ref && moved);
+
+	state->luapp_push_ref(copy);
+	state->luapp_push_ref(moved);
+	CHECK(state->rawequal(-1, -2));
+	state->getfield(-1, "name");
+	CHECK(state->tostdstring(-1) == "ref");
+	state->settop(0);
+
+	// A Ref into another State pushes nil.
+	auto other = Test::NewState();
+	other->luapp_push_ref(copy);
+	CHECK(other->isnil(-1));
+	other->settop(0);
+
+	// Refs outlive their State as invalid handles.
+	state->close();
+	CHECK(!copy && !moved && !copy.state());
+	Lua::Ref copyOfClosed = copy;
+	CHECK(!copyOfClosed);
+}
+
+static void TestOtherThreads() {
+	auto state = Test::NewState();
+	Lua::Ref ref = PopTable(*state, "return {}");
+	int const key = ref.key();
+
+	// Dropped on a worker thread, the key is released by the owner.
+	std::thread([ref = std::move(ref)]() mutable { ref.reset(); }).join();
+	state->luapp_drain_releases();
+	Lua::Ref reused = PopTable(*state, "return {}");
+	CHECK(reused.key() == key);
+
+	// Other threads may not copy it.
+	bool thrown = false;
+	std::thread([&]() {
+		try {
+			Lua::Ref copy = reused;
+		}
+		catch(Lua::lua_exception&) {
+			thrown = true;
+		}
+	}).join();
+	CHECK(thrown);
+
+	// Another thread may copy Refs once it owns the State.
+	bool copied = false;
+	std::thread([&]() {
+		state->luapp_claim_thread();
+		Lua::Ref copy = reused;
+		copied = copy && copy.key() != reused.key();
+	}).join();
+	state->luapp_claim_thread();
+	CHECK(copied);
+	state->luapp_drain_releases();
+	Lua::Ref copy = reused;
+	CHECK(copy);
+}
+
+static void TestReleases() {
+	auto state = Test::NewState();
+	lua_State* L = state->GetState();
+
+	// The owning thread releases at once: the next raw luaL_ref, which does
+	// not drain the queue, reuses the key.
+	Lua::Ref ref = PopTable(*state, "return {}");
+	int key = ref.key();
+	ref.reset();
+	state->newtable();
+	int reused = luaL_ref(L, LUA_REGISTRYINDEX);
+	CHECK(reused == key);
+	luaL_unref(L, LUA_REGISTRYINDEX, reused);
+
+	// Other threads queue the key until the owner drains the queue.
+	ref = PopTable(*state, "return {}");
+	key = ref.key();
+	std::thread([ref = std::move(ref)]() mutable { ref.reset(); }).join();
+	state->newtable();
+	reused = luaL_ref(L, LUA_REGISTRYINDEX);
+	CHECK(reused != key);
+	luaL_unref(L, LUA_REGISTRYINDEX, reused);
+	state->luapp_drain_releases();
+	state->newtable();
+	CHECK(luaL_ref(L, LUA_REGISTRYINDEX) == key);
+
+	// References into another table are released by the owner, and left
+	// alone by other threads rather than queued against the registry.
+	state->settop(0);
+	state->newtable();
+	state->pushboolean(true);
+	Lua::ReferenceType inTable = state->luapp_pop_reference(1);
+	key = inTable->key();
+	std::thread([inTable = std::move(inTable)]() mutable { inTable.reset(); }).join();
+	state->luapp_drain_releases();
+	CHECK(state->rawgeti(1, key) == Lua::TP_BOOL);
+	state->pop(1);
+
+	state->pushboolean(true);
+	inTable = state->luapp_pop_reference(1);
+	key = inTable->key();
+	inTable.reset();
+	CHECK(state->rawgeti(1, key) != Lua::TP_BOOL);
+	state->settop(0);
+}
+
+int main() {
+	TestValues();
+	TestOtherThreads();
+	TestReleases();
+	return Test::Result();
+}
@@ -0,0 +1,79 @@
+#include "Test.hpp"
+
+#include <utility>
+
+struct Counted {
+	static int destructions;
+	~Counted() { ++destructions; }
+};
+int Counted::destructions = 0;
+
+template <>
+struct MetatableDescriptor<Counted> {
+	static char const* name() { return "test_counted_mt"; }
+	static char const* luaname() { return "Counted"; }
+	static char const* constructor() { return "new"; }
+	static bool construct(Counted* p) { return Lua::DefaultConstructor(p); }
+};
+
+static int add(int a, int b) {
+	return a + b;
+}
+
+// Bound functions get a State bound to the thread they are called from.
+static void TestCoroutineState() {
+	auto state = Test::NewState();
+	state->luapp_add_translated_function("current", [](Lua::State& s) -> int {
+		lua_pushthread(s.GetState());
+		return 1;
+	});
+	state->luapp_add_translated_function("fail", [](Lua::State& s) -> int { return s.error("failed in %s", "coroutine"); });
+	state->luapp_add_translated_function("add", Lua::Transform<&add>());
+
+	CHECK(Lua::State::FromLuaState(state->GetState()) == state.get());
+	lua_State* thread = lua_newthread(state->GetState());
+	CHECK(Lua::State::FromLuaState(thread) == state.get());
+	state->pop(1);
+
+	CHECK_RUN(*state, "assert(current() == coroutine.running())");
+	CHECK_RUN(*state, R"(
+		local co = coroutine.create(function() return current() == coroutine.running(), add(2, 3) end)
+		local ok, same, sum = coroutine.resume(co)
+		assert(ok and same and sum == 5)
+	)");
+	// Errors leave the view behind; the coroutine and the State stay usable.
+	CHECK_RUN(*state, R"(
+		for i = 1, 100 do
+			local co = coroutine.wrap(function() return pcall(fail) end)
+			local ok, message = co()
+			assert(not ok and message:find("failed in coroutine"))
+			co = coroutine.wrap(function() return pcall(add, "x") end)
+			ok, message = co()
+			assert(not ok and message:find("argument #1"))
+		end
+	)");
+}
+
+// Assigning a State closes the one it held, whose objects are destroyed.
+static void TestMoveAssignment() {
+	auto a = Test::NewState();
+	auto b = Test::NewState();
+	a->luapp_register_object<Counted>();
+	b->luapp_register_object<Counted>();
+	CHECK_RUN(*b, "kept = Counted.new()");
+
+	Counted::destructions = 0;
+	*b = std::move(*a);
+	CHECK(Counted::destructions == 1);
+	CHECK(Lua::State::FromLuaState(b->GetState()) == b.get());
+	CHECK_RUN(*b, "assert(kept == nil) kept = Counted.new()");
+
+	b->close();
+	CHECK(Counted::destructions == 2);
+}
+
+int main() {
+	TestCoroutineState();
+	TestMoveAssignment();
+	return Test::Result();
+}
@@ -0,0 +1,66 @@
+#include "Test.hpp"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Views of Lua strings. This test is built as C++20, so that the
+// std::span converters are covered too.
+
+static std::size_t lengthOf(std::string_view text) {
+	return text.size();
+}
+static std::string echo(std::string_view text) {
+	return std::string(text);
+}
+
+static void TestStringView() {
+	auto state = Test::NewState();
+	state->luapp_add_translated_function("lengthOf", Lua::Transform<&lengthOf>());
+	state->luapp_add_translated_function("echo", Lua::Transform<&echo>());
+
+	CHECK_RUN(*state, "assert(lengthOf('hello') == 5) assert(lengthOf('a\\0b') == 3)");
+	CHECK_RUN(*state, "assert(echo('') == '')");
+
+	// Numbers are not converted, as that would change the argument.
+	CHECK_ERROR(*state, "lengthOf(12)", "argument #1");
+	CHECK_ERROR(*state, "lengthOf(true)", "argument #1");
+	CHECK_ERROR(*state, "lengthOf(nil)", "argument #1");
+
+	state->pushinteger(42);
+	CHECK(!Lua::TypeConverter<std::string_view>::Read(*state, -1));
+	CHECK(state->type(-1) == Lua::TP_NUMBER);
+	state->pop(1);
+}
+
+#ifdef __cpp_lib_span
+static std::size_t countZeros(std::span<std::byte const> bytes) {
+	std::size_t zeros = 0;
+	for(std::byte b : bytes)
+		zeros += b == std::byte(0);
+	return zeros;
+}
+
+static void TestSpan() {
+	auto state = Test::NewState();
+	state->luapp_add_translated_function("countZeros", Lua::Transform<&countZeros>());
+	CHECK_RUN(*state, "assert(countZeros('a\\0b\\0') == 2)");
+	CHECK_ERROR(*state, "countZeros(0)", "argument #1");
+
+	char const text[] = "span";
+	Lua::TypeConverter<std::span<char const>>::Push(*state, std::span<char const>(text, 4));
+	auto read = Lua::TypeConverter<std::span<char const>>::Read(*state, -1);
+	CHECK(read && std::string_view(read->data(), read->size()) == "span");
+	state->pop(1);
+}
+#endif
+
+int main() {
+	TestStringView();
+#ifdef __cpp_lib_span
+	TestSpan();
+#else
+	CHECK(!"Test_Strings must be built as C++20");
+#endif
+	return Test::Result();
+}
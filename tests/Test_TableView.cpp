@@ -0,0 +1,105 @@
+#include "Test.hpp"
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A key type whose converter turns numbers into strings in place, as
+// lua_tolstring does.
+struct Label {
+	std::string text;
+};
+
+template <>
+struct Lua::TypeConverter<Label> {
+	typedef std::optional<Label> Arg;
+	static Arg Read(Lua::State& s, int id) {
+		std::size_t size = 0;
+		char const* text = lua_tolstring(s.GetState(), id, &size);
+		if(!text)
+			return std::nullopt;
+		return Label { std::string(text, size) };
+	}
+	static std::size_t Push(Lua::State& s, Label const& v) {
+		s.pushlstring(v.text.c_str(), v.text.size());
+		return 1;
+	}
+	static std::string Name() { return "label"; }
+	static char const* TypeName() { return "label"; }
+};
+
+static Lua::TableView PushTable(Lua::State& state, char const* code) {
+	state.loadstring(code);
+	state.pcall(0, 1, 0);
+	return Lua::TableView(state, -1);
+}
+
+static void TestLookups() {
+	auto state = Test::NewState();
+	Lua::TableView table = PushTable(*state, "return { 10, 20, 30, name = 'ann', inner = { x = 1 } }");
+
+	CHECK(table.size() == 3);
+	CHECK(table.get<int>(2) == 20);
+	CHECK(table.get<std::string>("name") == std::string("ann"));
+	CHECK(!table.get<int>("name"));
+	CHECK(table.contains("inner") && !table.contains("missing") && !table.contains(4));
+	std::optional<Lua::TableView> inner = table.get<Lua::TableView>("inner");
+	CHECK(inner && inner->get<int>("x") == 1);
+	state->settop(0);
+}
+
+static void TestIteration() {
+	auto state = Test::NewState();
+	Lua::TableView table = PushTable(*state, "return { 1, 2, 3, 4, five = 5, six = 6 }");
+	int const top = state->gettop();
+
+	// Numeric keys are not strings, so they are skipped.
+	std::map<std::string, int> named;
+	table.forEach<std::string_view, int>([&named](std::string_view key, int value) { named.emplace(std::string(key), value); });
+	CHECK(named == std::map<std::string, int>({ { "five", 5 }, { "six", 6 } }));
+
+	// A converter that changes numeric keys in place does not break lua_next.
+	int visited = 0;
+	table.forEach<Label, int>([&visited](Label, int) { ++visited; });
+	CHECK(visited == 6);
+	CHECK_RUN(*state, "return true");
+	CHECK(state->type(top) == Lua::TP_TABLE && state->gettop() == top);
+
+	int sum = 0;
+	CHECK(table.forEachElement<int>([&sum](lua_Integer i, int value) { sum += static_cast<int>(i) * value; }));
+	CHECK(sum == 1 + 4 + 9 + 16);
+	CHECK(!table.forEachElement<std::string_view>([](lua_Integer, std::string_view) {}));
+
+	// The callback may stop the iteration.
+	int seen = 0;
+	table.forEach<Label, int>([&seen](Label, int) { return ++seen < 2; });
+	CHECK(seen == 2);
+	CHECK(state->gettop() == top);
+}
+
+// Nested views stay on the stack, far beyond LUA_MINSTACK slots.
+static void TestNestedViews() {
+	auto state = Test::NewState();
+	Lua::TableView table = PushTable(*state, "local t = {} for i = 1, 200 do t[i] = { value = i } end return t");
+	int const top = state->gettop();
+
+	std::vector<Lua::TableView> views;
+	for(int i = 1; i <= 200; ++i)
+		if(std::optional<Lua::TableView> view = table.get<Lua::TableView>(i))
+			views.push_back(*view);
+	CHECK(views.size() == 200 && state->gettop() == top + 200);
+
+	bool read = true;
+	for(std::size_t i = 0; i < views.size(); ++i)
+		read = read && views[i].get<int>("value") == static_cast<int>(i + 1);
+	CHECK(read);
+	state->settop(0);
+}
+
+int main() {
+	TestLookups();
+	TestNestedViews();
+	TestIteration();
+	return Test::Result();
+}
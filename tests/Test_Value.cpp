@@ -0,0 +1,130 @@
+#include "Test.hpp"
+
+#include <string>
+
+static Lua::Value ReadGlobal(Lua::State& state, char const* code) {
+	state.loadstring(code);
+	state.pcall(0, 1, 0);
+	std::optional<Lua::Value> value = Lua::Value::Read(state, -1);
+	state.pop(1);
+	CHECK(value.has_value());
+	return value ? *value : Lua::Value();
+}
+
+static void TestRoundTrip() {
+	auto state = Test::NewState();
+	Lua::Value value = ReadGlobal(*state, "return { 1, 2.5, 'three', n = { x = true }, [10] = 'ten', [2.0^70] = 'big' }");
+
+	Lua::ValueTable const* table = value.get_if<Lua::ValueTable>();
+	CHECK(table && table->arraySize() == 3 && table->hashSize() == 3);
+	CHECK(value.find(1) && *value.find(1)->get_if<lua_Integer>() == 1);
+	CHECK(value.find(10) && value.find(10)->string() == std::string_view("ten"));
+	CHECK(value.find("n") && value.find("n")->find("x") && *value.find("n")->find("x")->get_if<bool>());
+	CHECK(table && table->find(Lua::Value(10.0)) == value.find(10));
+
+	value.push(*state);
+	state->setglobal("copy");
+	CHECK_RUN(*state, "assert(copy[1] == 1 and math.type(copy[1]) == 'integer' and copy[2] == 2.5 and copy[3] == 'three')");
+	CHECK_RUN(*state, "assert(copy.n.x == true and copy[10] == 'ten' and copy[2.0^70] == 'big' and #copy == 3)");
+	CHECK(ReadGlobal(*state, "return copy") == value);
+}
+
+static void TestLimits() {
+	auto state = Test::NewState();
+	CHECK_RUN(*state, "cyclic = {} cyclic.self = cyclic deep = {} local t = deep for i = 1, 40 do t.next = {} t = t.next end");
+	state->getglobal("cyclic");
+	CHECK(!Lua::Value::Read(*state, -1) && !Lua::Value::Readable(*state, -1));
+	state->getglobal("deep");
+	CHECK(!Lua::Value::Read(*state, -1) && !Lua::Value::Readable(*state, -1));
+	CHECK(Lua::Value::Read(*state, -1, 64) && Lua::Value::Readable(*state, -1, 64));
+	state->settop(0);
+
+	// A table seen twice without a cycle is fine.
+	CHECK_RUN(*state, "shared = {} shared = { a = shared, b = shared }");
+	state->getglobal("shared");
+	CHECK(Lua::Value::Readable(*state, -1) && Lua::Value::Read(*state, -1));
+	state->settop(0);
+}
+
+static void TestHashIndex() {
+	// Enough keys for the open addressing index.
+	Lua::ValueTable table;
+	for(int i = 0; i < 100; ++i) {
+		table.set(Lua::Value("key" + std::to_string(i)), Lua::Value(i));
+		table.set(Lua::Value(-i - 1), Lua::Value(i));
+	}
+	CHECK(table.arraySize() == 0 && table.hashSize() == 200);
+	bool found = true;
+	for(int i = 0; i < 100; ++i) {
+		std::string const key = "key" + std::to_string(i);
+		Lua::Value const* byString = table.find(std::string_view(key));
+		Lua::Value const* byInteger = table.find(static_cast<lua_Integer>(-i - 1));
+		found = found && byString && *byString == Lua::Value(i) && byInteger && *byInteger == Lua::Value(i);
+	}
+	CHECK(found);
+	CHECK(!table.find("key100") && !table.find(lua_Integer(0)));
+
+	// Setting an existing key replaces its value, whatever the key.
+	table.set(Lua::Value("key7"), Lua::Value("seven"));
+	table.set(Lua::Value(-8.0), Lua::Value("minus eight"));
+	CHECK(table.hashSize() == 200 && table.find("key7")->string() == std::string_view("seven"));
+	CHECK(table.find(-8)->string() == std::string_view("minus eight"));
+}
+
+static void TestTableKeys() {
+	Lua::ValueTable key;
+	key.append(Lua::Value(1));
+	key.set(Lua::Value("name"), Lua::Value("a"));
+
+	Lua::ValueTable table;
+	table.set(Lua::Value(key), Lua::Value(1));
+	table.set(Lua::Value(key), Lua::Value(2));
+	CHECK(table.hashSize() == 1);
+	CHECK(table.find(Lua::Value(key)) && *table.find(Lua::Value(key)) == Lua::Value(2));
+
+	Lua::ValueTable other = key;
+	other.set(Lua::Value("name"), Lua::Value("b"));
+	CHECK(!table.find(Lua::Value(other)));
+}
+
+// Functions compare as in Lua, whichever Read gave them.
+static void TestReferences() {
+	auto state = Test::NewState();
+	CHECK_RUN(*state, "f = function() end t = { f = print, g = f, 1, [print] = 'print', [f] = 'f' }");
+	Lua::Value const a = ReadGlobal(*state, "return t");
+	Lua::Value const b = ReadGlobal(*state, "return t");
+	CHECK(a == b);
+	CHECK(*a.find("f") == ReadGlobal(*state, "return print") && *a.find("g") != *a.find("f"));
+
+	Lua::ValueTable const* table = a.get_if<Lua::ValueTable>();
+	Lua::Value const* byPrint = table ? table->find(ReadGlobal(*state, "return print")) : nullptr;
+	Lua::Value const* byF = table ? table->find(ReadGlobal(*state, "return f")) : nullptr;
+	CHECK(byPrint && byPrint->string() == std::string_view("print"));
+	CHECK(byF && byF->string() == std::string_view("f"));
+	CHECK(!table || !table->find(ReadGlobal(*state, "return function() end")));
+	CHECK(ReadGlobal(*state, "return f") != ReadGlobal(*state, "return function() end"));
+}
+
+static std::string describe(Lua::Value value) {
+	return value.find("name") ? "value" : "other";
+}
+static std::string describeNumber(int) {
+	return "number";
+}
+
+static void TestOverloads() {
+	auto state = Test::NewState();
+	state->luapp_add_translated_function("describe", Lua::Overload(&describeNumber, &describe));
+	CHECK_RUN(*state, "assert(describe(1) == 'number' and describe({ name = 1 }) == 'value')");
+	CHECK_ERROR(*state, "local t = {} t.t = t describe(t)", "No overload");
+}
+
+int main() {
+	TestRoundTrip();
+	TestLimits();
+	TestHashIndex();
+	TestTableKeys();
+	TestReferences();
+	TestOverloads();
+	return Test::Result();
+}
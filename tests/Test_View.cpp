@@ -0,0 +1,70 @@
+#include "Test.hpp"
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+static void TestSequence() {
+	auto state = Test::NewState();
+	std::vector<int> numbers { 1, 2, 3 };
+	state->luapp_push_value(Lua::View(numbers));
+	state->setglobal("numbers");
+
+	CHECK_RUN(*state, "assert(#numbers == 3 and numbers[1] == 1 and numbers[4] == nil)");
+	CHECK_RUN(*state, "numbers[2] = 20 numbers[#numbers + 1] = 4");
+	CHECK(numbers == std::vector<int>({ 1, 20, 3, 4 }));
+	CHECK_RUN(*state, "local sum = 0 for i, v in pairs(numbers) do sum = sum + i * v end assert(sum == 1 + 40 + 9 + 16)");
+	CHECK_ERROR(*state, "numbers[7] = 1", "out of range");
+	CHECK_ERROR(*state, "numbers[1] = 'x'", "Cannot store");
+
+	state->luapp_invalidate_view(&numbers);
+	CHECK_ERROR(*state, "return numbers[1]", "no longer exists");
+}
+
+static void TestMapAndList() {
+	auto state = Test::NewState();
+	std::map<std::string, int> ages { { "ann", 31 }, { "bob", 42 } };
+	std::list<int> const items { 5, 6, 7 };
+	state->luapp_push_value(Lua::View(ages));
+	state->setglobal("ages");
+	state->luapp_push_value(Lua::ReadOnlyView(items));
+	state->setglobal("items");
+
+	CHECK_RUN(*state, "assert(ages.ann == 31 and ages.eve == nil) ages.eve = 27 ages.bob = nil");
+	CHECK(ages.size() == 2 && ages.at("eve") == 27);
+	CHECK_RUN(*state, "local n = 0 for k, v in pairs(ages) do n = n + v end assert(n == 58)");
+	// Erasing the current key is allowed during the traversal.
+	CHECK_RUN(*state, "for k in pairs(ages) do ages[k] = nil end assert(#ages == 0)");
+
+	CHECK_RUN(*state, "local n = 0 for i, v in pairs(items) do n = n + i * v end assert(n == 5 + 12 + 21)");
+	CHECK_ERROR(*state, "items[1] = 1", "read-only");
+}
+
+// Metamethods and iterators reached through getmetatable get any value.
+static void TestForeignValues() {
+	auto state = Test::NewState();
+	std::vector<int> numbers { 1, 2, 3 };
+	std::map<std::string, int> ages { { "ann", 31 } };
+	state->luapp_push_value(Lua::View(numbers));
+	state->setglobal("numbers");
+	state->luapp_push_value(Lua::View(ages));
+	state->setglobal("ages");
+
+	CHECK_ERROR(*state, "getmetatable(numbers).__len(io.stdout)", "Lua::View expected");
+	CHECK_ERROR(*state, "getmetatable(numbers).__index(io.stdout, 1)", "Lua::View expected");
+	CHECK_ERROR(*state, "getmetatable(numbers).__newindex(io.stdout, 1, 1)", "Lua::View expected");
+	CHECK_ERROR(*state, "getmetatable(numbers).__len(ages)", "Lua::View expected");
+	CHECK_ERROR(*state, "local f = pairs(numbers) f(io.stdout, 0)", "Lua::View expected");
+	CHECK_ERROR(*state, "local f = pairs(numbers) f(ages, 0)", "Lua::View expected");
+
+	// A map cursor walks the view it was made for, whatever it is given.
+	CHECK_RUN(*state, "local f, v = pairs(ages) assert(f(io.stdout) == 'ann') assert(f(v) == nil)");
+}
+
+int main() {
+	TestSequence();
+	TestMapAndList();
+	TestForeignValues();
+	return Test::Result();
+}